@@ -0,0 +1,345 @@
+#ifndef ARENAPOOL_H
+#define ARENAPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "MemoryPool.h"
+
+/***** Sample Usage:
+ * ArenaPool<Particle, false, PoolWatchNone> particles;
+ * for each frame:
+ *     Particle* p = particles.request(x, y);
+ *     ...
+ *     particles.reset();          // Every particle gone at once
+ *
+ * // Destructors run on reset(), for objects which were not released
+ * ArenaPool<std::string, true> scratch;
+ *****/
+
+/**
+ * ArenaPool
+ *
+ * Pool for short lived objects which die together, such as per frame or per
+ * request scratch. A request bumps a pointer through a chain of blocks, and
+ * reset() reclaims every object at once in O(1), keeping the blocks for the
+ * next round.
+ *
+ * Memory of a released object is not reused before reset(), unless it was
+ * the last object requested. Releasing a trivially destructible object costs
+ * nothing else.
+ *
+ * TrackDtors keeps the live objects in an intrusive list, so that reset()
+ * and the destructor run the destructors of objects which were not
+ * released. Without it, such objects are dropped without being destructed,
+ * like the objects of a MemoryPool which is destroyed.
+ *
+ * Watch is one of the watch policies of MemoryPool. reset() does not call
+ * onRelease for the objects it drops.
+ */
+template <class C, bool TrackDtors = false, class Watch = PoolWatchCallbacks> class ArenaPool : public Pool, private Watch
+{
+private:
+    /** Header in front of each object, only when tracking destructors */
+    struct Link {
+        Link* prev;
+        Link* next;
+    };
+
+    /** Header at the start of each block, the objects follow it */
+    struct Block {
+        Block* next;
+    };
+
+    Block* blocks;   // First block, the chain is kept across reset()
+    Block* current;  // Block being bumped through
+    char*  cursor;   // Next object in the current block
+    char*  limit;    // End of the last object of the current block
+    Link   tracked;  // Sentinel of the list of live objects
+
+    PoolBacking* backing;
+
+    // Statistics
+    std::size_t numBlocks;
+    std::size_t live;
+    std::size_t peak;
+
+    /** Alignment of objects (and of links and blocks) */
+    static std::size_t alignment ()
+    {
+        std::size_t a = alignof(C) > alignof(Block) ? alignof(C) : alignof(Block);
+        return TrackDtors && alignof(Link) > a ? alignof(Link) : a;
+    }
+
+    /** Offset of the object from the start of its slot */
+    static std::size_t objectOffset ()
+    {
+        return TrackDtors ? poolRoundUp(sizeof(Link), alignment()) : 0;
+    }
+
+    /** Bytes between neighbouring objects */
+    static std::size_t stride ()
+    {
+        return poolRoundUp(objectOffset() + sizeof(C), alignment());
+    }
+
+    /** Offset of the first object from the start of its block */
+    static std::size_t blockHeader ()
+    {
+        return poolRoundUp(sizeof(Block), alignment());
+    }
+
+    static std::size_t blockBytes ()
+    {
+        return poolSlabBytes(stride());
+    }
+
+    static std::size_t blockObjects ()
+    {
+        return (blockBytes() - blockHeader()) / stride();
+    }
+
+    /** Start bumping through block b */
+    void enter (Block* b)
+    {
+        current = b;
+        cursor  = (char*)b + blockHeader();
+        limit   = cursor + blockObjects() * stride();
+    }
+
+    /** Move to the next block, allocating it if the chain ends here */
+    void advance ()
+    {
+        if (current && current->next)
+        {
+            enter(current->next);
+            return;
+        }
+        Block* b = (Block*)backing->allocate(blockBytes());
+        Watch::onAlloc(int(blockBytes()));
+        b->next = 0;
+        if (current)
+        {
+            current->next = b;
+        } else
+        {
+            blocks = b;
+        }
+        ++numBlocks;
+        enter(b);
+    }
+
+    /** Take the next slot */
+    char* take ()
+    {
+        if (cursor == limit)
+        {
+            advance();
+        }
+        char* slot = cursor;
+        cursor += stride();
+        return slot;
+    }
+
+    /** Hand the slot back if it was the last one taken */
+    void untake (char* slot)
+    {
+        if (slot + stride() == cursor)
+        {
+            cursor = slot;
+        }
+    }
+
+    void track (char* slot)
+    {
+        Link* l = (Link*)slot;
+        l->prev = &tracked;
+        l->next = tracked.next;
+        tracked.next->prev = l;
+        tracked.next = l;
+    }
+
+    static void untrack (char* slot)
+    {
+        Link* l = (Link*)slot;
+        l->prev->next = l->next;
+        l->next->prev = l->prev;
+    }
+
+    /** Destruct every tracked object */
+    void destructTracked ()
+    {
+        for (Link* l = tracked.next; l != &tracked; l = l->next)
+        {
+            ((C*)((char*)l + objectOffset()))->~C();
+        }
+        tracked.prev = tracked.next = &tracked;
+    }
+
+    void* defaultRequest (std::true_type)
+    {
+        return (void*)request();
+    }
+
+    void* defaultRequest (std::false_type)
+    {
+        return 0;
+    }
+
+public:
+    ArenaPool () : blocks(0), current(0), cursor(0), limit(0), backing(&poolDefaultBacking()), numBlocks(0), live(0), peak(0)
+    {
+        tracked.prev = tracked.next = &tracked;
+    }
+
+    ArenaPool (PoolWatcher* w) : blocks(0), current(0), cursor(0), limit(0), backing(&poolDefaultBacking()), numBlocks(0), live(0), peak(0)
+    {
+        tracked.prev = tracked.next = &tracked;
+        if (w)
+        {
+            addWatcher(w);
+        }
+    }
+
+    ArenaPool (PoolBacking& b, PoolWatcher* w=0) : blocks(0), current(0), cursor(0), limit(0), backing(&b), numBlocks(0), live(0), peak(0)
+    {
+        tracked.prev = tracked.next = &tracked;
+        if (w)
+        {
+            addWatcher(w);
+        }
+    }
+
+    ArenaPool (const ArenaPool&) = delete;
+    ArenaPool& operator= (const ArenaPool&) = delete;
+
+    /**
+     * Free all blocks.
+     * Objects which were not released are destructed only when tracking destructors.
+     */
+    ~ArenaPool ()
+    {
+        if (TrackDtors)
+        {
+            destructTracked();
+        }
+        while (blocks != 0)
+        {
+            Block* temp = blocks;
+            blocks = blocks->next;
+            backing->deallocate(temp, blockBytes());
+        }
+        Watch::onFree(int(blockBytes() * numBlocks));
+    }
+
+    /** Add a watcher to be notified of memory management events */
+    void addWatcher (PoolWatcher* w)
+    {
+        Watch::add(w);
+    }
+
+    /** The watch policy, to read its counters */
+    const Watch& watch () const
+    {
+        return *this;
+    }
+
+    unsigned objectSize () const
+    {
+        return sizeof(C);
+    }
+
+    /** Request the construction of a new object, passing args to its constructor */
+    template <class... Args> C* request (Args&&... args)
+    {
+        char* slot = take();
+        C* c = (C*)(slot + objectOffset());
+
+        try {
+            new(c) C(std::forward<Args>(args)...);
+        } catch (...) {
+            untake(slot);
+            throw;
+        }
+        if (TrackDtors)
+        {
+            track(slot);
+        }
+        if (++live > peak)
+        {
+            peak = live;
+        }
+
+        // Notify watchers once the object exists
+        Watch::onRequest(c, sizeof(C));
+        return c;
+    }
+
+    /**
+     * Release and destruct an object. Its memory is reused before reset()
+     * only if it was the last object requested.
+     */
+    void release (const C* const c)
+    {
+        char* slot = (char*)c - objectOffset();
+        if (TrackDtors)
+        {
+            untrack(slot);
+        }
+        c->~C();
+        Watch::onRelease((void*)c, sizeof(C));
+        untake(slot);
+        --live;
+    }
+
+    /**
+     * Drop every object and start again from the first block, keeping all
+     * blocks. O(1), unless tracking destructors, when the live objects are
+     * destructed.
+     */
+    void reset ()
+    {
+        if (TrackDtors)
+        {
+            destructTracked();
+        }
+        if (blocks)
+        {
+            enter(blocks);
+        }
+        live = 0;
+    }
+
+    /** Current object counts. Blocks count as slabs. */
+    PoolStats stats () const
+    {
+        std::size_t ahead = 0;
+        for (Block* b = current ? current->next : 0; b; b = b->next)
+        {
+            ++ahead;
+        }
+        PoolStats s;
+        s.live  = live;
+        s.peak  = peak;
+        s.free  = (limit - cursor) / stride() + ahead * blockObjects();
+        s.slabs = numBlocks;
+        s.bytes = numBlocks * blockBytes();
+        return s;
+    }
+
+    /** Default construct an object, or return 0 if C has no default constructor */
+    void* req ()
+    {
+        return defaultRequest(typename std::is_default_constructible<C>::type());
+    }
+
+    void rel(void* o)
+    {
+        release((const C* const)o);
+    }
+};
+
+#endif // ARENAPOOL_H
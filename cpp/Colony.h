@@ -0,0 +1,478 @@
+#ifndef COLONY_H
+#define COLONY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <utility>
+
+#include "MemoryPool.h"
+
+/***** Sample Usage:
+ * Colony<Particle> particles;
+ * Particle* p = particles.insert(x, y);
+ * ...
+ * for (Colony<Particle>::iterator i = particles.begin(); i != particles.end(); )
+ * {
+ *     i->update();
+ *     if (i->dead)
+ *         i = particles.erase(i);
+ *     else
+ *         ++i;
+ * }
+ * particles.erase(p);             // Or erase by pointer, found from its address
+ *****/
+
+/**
+ * Colony
+ *
+ * Pooled container of objects which keeps track of its live objects, so they
+ * can be walked in memory order. Inserting and erasing are O(1), and objects
+ * never move while they are live.
+ *
+ * Objects are kept in blocks, which like MemoryPool slabs are aligned to
+ * their own size, so the block of an object is found from its address alone.
+ * Each block has a jump-counting skipfield (the low complexity variant): a
+ * run of erased objects stores its length in the skipfield at both of its
+ * ends and is zero under live objects. Iteration jumps over each run in one
+ * step, so a sweep costs about one extra load per live object.
+ *
+ * Runs of erased objects are kept in a free list per block, linked through
+ * the storage of the first object of each run, and blocks with erased objects
+ * are kept in a list of their own; insertion reuses the first object of a run
+ * before growing. A block is given back once all of its objects are erased.
+ */
+template <class C> class Colony
+{
+private:
+    static const std::uint16_t NONE = 0xFFFF;
+
+    /** Storage of one object, or the free list links of a run of erased objects */
+    union Slot {
+        alignas(C) unsigned char object[sizeof(C)];
+        struct {
+            std::uint16_t prev;
+            std::uint16_t next;
+        } run;
+    };
+
+    /** Header at the start of each block, the skipfield and then the objects follow it */
+    struct Block {
+        Block*         next;         // Blocks in iteration order
+        Block*         prev;
+        Block*         nextErased;   // Blocks with runs of erased objects
+        Block*         prevErased;
+        std::uint16_t* skip;         // capacity() + 1 entries, the last is always zero
+        Slot*          slots;
+        std::size_t    top;          // Objects ever used; beyond this, never constructed
+        std::size_t    size;         // Live objects
+        std::uint16_t  runs;         // First run of erased objects, or NONE
+    };
+
+    Block*       first;
+    Block*       last;
+    Block*       erased;   // First block with erased objects
+    std::size_t  count;
+    PoolBacking* backing;
+
+    static std::size_t blockBytes ()
+    {
+        return poolSlabBytes(sizeof(Slot) + sizeof(std::uint16_t));
+    }
+
+    /** Objects in one block, limited so that skipfield values and run links fit in 16 bits */
+    static std::size_t capacity ()
+    {
+        std::size_t cap = (blockBytes() - sizeof(Block) - sizeof(std::uint16_t) - alignof(Slot)) / (sizeof(Slot) + sizeof(std::uint16_t));
+        return cap < NONE ? cap : NONE - 1;
+    }
+
+    static Block* blockOf (const void* p)
+    {
+        return (Block*)((std::uintptr_t)p & ~(std::uintptr_t)(blockBytes() - 1));
+    }
+
+    static C* object (Block* b, std::size_t i)
+    {
+        return (C*)b->slots[i].object;
+    }
+
+    /** Allocate a block and put it at the end of the iteration order */
+    Block* grow ()
+    {
+        const std::size_t cap = capacity();
+        char* mem = (char*)backing->allocate(blockBytes());
+        Block* b = (Block*)mem;
+        b->skip  = (std::uint16_t*)(mem + sizeof(Block));
+        b->slots = (Slot*)poolRoundUp((std::uintptr_t)(b->skip + cap + 1), alignof(Slot));
+        for (std::size_t i = 0; i <= cap; ++i)
+        {
+            b->skip[i] = 0;
+        }
+        b->top  = 0;
+        b->size = 0;
+        b->runs = NONE;
+        b->nextErased = b->prevErased = 0;
+        b->next = 0;
+        b->prev = last;
+        if (last)
+        {
+            last->next = b;
+        } else
+        {
+            first = b;
+        }
+        last = b;
+        return b;
+    }
+
+    void linkErased (Block* b)
+    {
+        b->prevErased = 0;
+        b->nextErased = erased;
+        if (erased)
+        {
+            erased->prevErased = b;
+        }
+        erased = b;
+    }
+
+    void unlinkErased (Block* b)
+    {
+        if (b->prevErased)
+        {
+            b->prevErased->nextErased = b->nextErased;
+        } else
+        {
+            erased = b->nextErased;
+        }
+        if (b->nextErased)
+        {
+            b->nextErased->prevErased = b->prevErased;
+        }
+    }
+
+    /** Give back a block with no live objects */
+    void freeBlock (Block* b)
+    {
+        if (b->runs != NONE)
+        {
+            unlinkErased(b);
+        }
+        if (b->prev)
+        {
+            b->prev->next = b->next;
+        } else
+        {
+            first = b->next;
+        }
+        if (b->next)
+        {
+            b->next->prev = b->prev;
+        } else
+        {
+            last = b->prev;
+        }
+        backing->deallocate(b, blockBytes());
+    }
+
+    /** Add the run starting at s to the block's free list */
+    static void pushRun (Block* b, std::uint16_t s)
+    {
+        b->slots[s].run.prev = NONE;
+        b->slots[s].run.next = b->runs;
+        if (b->runs != NONE)
+        {
+            b->slots[b->runs].run.prev = s;
+        }
+        b->runs = s;
+    }
+
+    static void unlinkRun (Block* b, std::uint16_t s)
+    {
+        std::uint16_t prev = b->slots[s].run.prev;
+        std::uint16_t next = b->slots[s].run.next;
+        if (prev != NONE)
+        {
+            b->slots[prev].run.next = next;
+        } else
+        {
+            b->runs = next;
+        }
+        if (next != NONE)
+        {
+            b->slots[next].run.prev = prev;
+        }
+    }
+
+    /** Move the free list entry of a run from s to t, its new first object */
+    static void moveRun (Block* b, std::uint16_t s, std::uint16_t t)
+    {
+        std::uint16_t prev = b->slots[s].run.prev;
+        std::uint16_t next = b->slots[s].run.next;
+        b->slots[t].run.prev = prev;
+        b->slots[t].run.next = next;
+        if (prev != NONE)
+        {
+            b->slots[prev].run.next = t;
+        } else
+        {
+            b->runs = t;
+        }
+        if (next != NONE)
+        {
+            b->slots[next].run.prev = t;
+        }
+    }
+
+    /** Find room for an object: the first object of a run of erased objects, or a fresh one */
+    void* take (Block*& b, std::size_t& i)
+    {
+        if (erased)
+        {
+            b = erased;
+            std::uint16_t s = b->runs;
+            std::uint16_t length = b->skip[s];
+            if (length == 1)
+            {
+                unlinkRun(b, s);
+                if (b->runs == NONE)
+                {
+                    unlinkErased(b);
+                }
+            } else
+            {
+                // The run now starts one further on
+                moveRun(b, s, s + 1);
+                b->skip[s + 1] = b->skip[s + length - 1] = length - 1;
+            }
+            b->skip[s] = 0;
+            i = s;
+        } else
+        {
+            b = last;
+            if (b == 0 || b->top == capacity())
+            {
+                b = grow();
+            }
+            i = b->top++;
+        }
+        return b->slots[i].object;
+    }
+
+    /** Add object i of block b, which is not live, to the runs of erased objects */
+    void vacate (Block* b, std::size_t i)
+    {
+        if (b->size == 0)
+        {
+            freeBlock(b);
+            return;
+        }
+
+        const std::uint16_t left  = i > 0 ? b->skip[i - 1] : 0;
+        const std::uint16_t right = b->skip[i + 1];
+        if (left == 0 && right == 0)
+        {
+            // A new run
+            b->skip[i] = 1;
+            if (b->runs == NONE)
+            {
+                linkErased(b);
+            }
+            pushRun(b, (std::uint16_t)i);
+        } else if (right == 0)
+        {
+            // Extend the run on the left, i is its new end
+            b->skip[i - left] = b->skip[i] = left + 1;
+        } else if (left == 0)
+        {
+            // Extend the run on the right, i is its new start
+            moveRun(b, (std::uint16_t)(i + 1), (std::uint16_t)i);
+            b->skip[i] = b->skip[i + right] = right + 1;
+        } else
+        {
+            // Join the runs on both sides
+            unlinkRun(b, (std::uint16_t)(i + 1));
+            b->skip[i - left] = b->skip[i + right] = left + right + 1;
+            b->skip[i] = 1;
+        }
+    }
+
+    /** Destruct object i of block b */
+    void erase (Block* b, std::size_t i)
+    {
+        object(b, i)->~C();
+        --b->size;
+        --count;
+        vacate(b, i);
+    }
+
+public:
+    /** Forward iterator over live objects, in memory order within each block */
+    template <class V> class basic_iterator
+    {
+    private:
+        friend class Colony;
+
+        Block*      block;
+        std::size_t index;
+
+        basic_iterator (Block* b, std::size_t i) : block(b), index(i) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef V                         value_type;
+        typedef std::ptrdiff_t            difference_type;
+        typedef V*                        pointer;
+        typedef V&                        reference;
+
+        basic_iterator () : block(0), index(0) {}
+
+        /** A const_iterator from an iterator */
+        template <class W> basic_iterator (const basic_iterator<W>& other) : block(other.block), index(other.index) {}
+
+        V& operator* () const
+        {
+            return *(V*)block->slots[index].object;
+        }
+
+        V* operator-> () const
+        {
+            return (V*)block->slots[index].object;
+        }
+
+        basic_iterator& operator++ ()
+        {
+            ++index;
+            index += block->skip[index];
+            if (index >= block->top)
+            {
+                block = block->next;
+                index = block ? block->skip[0] : 0;
+            }
+            return *this;
+        }
+
+        basic_iterator operator++ (int)
+        {
+            basic_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        template <class W> bool operator== (const basic_iterator<W>& other) const
+        {
+            return block == other.block && index == other.index;
+        }
+
+        template <class W> bool operator!= (const basic_iterator<W>& other) const
+        {
+            return !(*this == other);
+        }
+
+        template <class W> friend class basic_iterator;
+    };
+
+    typedef basic_iterator<C>       iterator;
+    typedef basic_iterator<const C> const_iterator;
+
+    Colony () : first(0), last(0), erased(0), count(0), backing(&poolDefaultBacking())
+    {
+    }
+
+    Colony (PoolBacking& b) : first(0), last(0), erased(0), count(0), backing(&b)
+    {
+    }
+
+    Colony (const Colony&) = delete;
+    Colony& operator= (const Colony&) = delete;
+
+    /** Destruct every live object and free all blocks */
+    ~Colony ()
+    {
+        clear();
+    }
+
+    /** Construct an object, passing args to its constructor. Its address is stable until it is erased. */
+    template <class... Args> C* insert (Args&&... args)
+    {
+        Block* b;
+        std::size_t i;
+        void* p = take(b, i);
+        try {
+            new(p) C(std::forward<Args>(args)...);
+        } catch (...) {
+            vacate(b, i);
+            throw;
+        }
+        ++b->size;
+        ++count;
+        return (C*)p;
+    }
+
+    /** Destruct an object and return the iterator following it */
+    iterator erase (iterator pos)
+    {
+        iterator next = pos;
+        ++next;
+        erase(pos.block, pos.index);
+        return next;
+    }
+
+    /** Destruct an object from insert() */
+    void erase (const C* c)
+    {
+        Block* b = blockOf(c);
+        erase(b, (Slot*)c - b->slots);
+    }
+
+    /** Destruct every live object and free all blocks */
+    void clear ()
+    {
+        for (iterator i = begin(); i != end(); ++i)
+        {
+            i->~C();
+        }
+        while (first)
+        {
+            Block* b = first;
+            first = first->next;
+            backing->deallocate(b, blockBytes());
+        }
+        last = erased = 0;
+        count = 0;
+    }
+
+    std::size_t size () const
+    {
+        return count;
+    }
+
+    bool empty () const
+    {
+        return count == 0;
+    }
+
+    iterator begin ()
+    {
+        return iterator(first, first ? first->skip[0] : 0);
+    }
+
+    iterator end ()
+    {
+        return iterator();
+    }
+
+    const_iterator begin () const
+    {
+        return const_iterator(first, first ? first->skip[0] : 0);
+    }
+
+    const_iterator end () const
+    {
+        return const_iterator();
+    }
+};
+
+#endif // COLONY_H
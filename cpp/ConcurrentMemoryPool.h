@@ -0,0 +1,490 @@
+#ifndef CONCURRENTMEMORYPOOL_H
+#define CONCURRENTMEMORYPOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "MemoryPool.h"
+
+/***** Sample Usage:
+ * ConcurrentMemoryPool<Foo> fooPool;
+ * // Any thread
+ * Foo* foo = fooPool.request();
+ * ...
+ * // Any thread, not necessarily the one which requested foo
+ * fooPool.release(foo);
+ *****/
+
+/** Most threads which can have their own cache in a ConcurrentMemoryPool at once */
+const unsigned POOL_MAX_THREADS = 128;
+
+/** Returned by poolThreadSlot() when all slots are taken */
+const unsigned POOL_NO_SLOT = ~0u;
+
+/**
+ * PoolThreadSlots
+ *
+ * Hands out a small, unique index to each running thread, which concurrent
+ * pools use to find the thread's cache. Indices are reused once their thread
+ * exits; the next thread to take an index inherits the free objects cached by
+ * the previous one.
+ */
+class PoolThreadSlots
+{
+private:
+    static std::mutex& lock ()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    static bool* used ()
+    {
+        static bool slots[POOL_MAX_THREADS] = {false,};
+        return slots;
+    }
+
+public:
+    static unsigned acquire ()
+    {
+        std::lock_guard<std::mutex> guard(lock());
+        bool* slots = used();
+        for (unsigned i = 0; i < POOL_MAX_THREADS; ++i)
+        {
+            if (!slots[i])
+            {
+                slots[i] = true;
+                return i;
+            }
+        }
+        return POOL_NO_SLOT;
+    }
+
+    static void release (unsigned slot)
+    {
+        if (slot != POOL_NO_SLOT)
+        {
+            std::lock_guard<std::mutex> guard(lock());
+            used()[slot] = false;
+        }
+    }
+};
+
+/** Slot of the calling thread, taken the first time the thread asks for it */
+inline unsigned poolThreadSlot ()
+{
+    struct Slot {
+        unsigned id;
+        Slot () : id(PoolThreadSlots::acquire()) {}
+        ~Slot () { PoolThreadSlots::release(id); }
+    };
+    static thread_local Slot slot;
+    return slot.id;
+}
+
+/**
+ * ConcurrentMemoryPool
+ *
+ * Thread safe memory pool with the same interface as MemoryPool.
+ *
+ * Each thread keeps a cache of free objects which it requests from and
+ * releases to without synchronization. Caches exchange fixed size batches of
+ * objects with a lock-free shared list when they run empty or overflow, so
+ * objects released on a different thread to the one which requested them
+ * simply flow back through the shared list. A mutex is only taken when the
+ * pool needs to allocate a new slab.
+ *
+ * The shared list is a stack of batches whose top pointer carries a tag in
+ * its unused high bits, which is bumped on every change to prevent ABA. This
+ * assumes user space addresses fit in 48 bits, which holds on x86-64 and
+ * AArch64.
+ *
+ * Watchers must be added before the pool is shared between threads, and
+ * must themselves be thread safe.
+ *
+ * Objects are aligned, and slabs allocated, as in MemoryPool.
+ */
+template <class C, std::size_t Align = 0> class alignas(POOL_CACHE_LINE) ConcurrentMemoryPool : public Pool, private PoolWatchCallbacks
+{
+private:
+    static_assert((Align & (Align - 1)) == 0, "ConcurrentMemoryPool alignment must be a power of two");
+
+    /** Overlaid on the storage of each free object */
+    struct Node {
+        Node*              next;  // Next object in the same batch
+        std::atomic<Node*> batch; // Next batch in the shared list, only set on the first object of a batch
+        unsigned           count; // Objects in the batch, only set on the first object of a batch
+    };
+
+    /** Per thread list of free objects, aligned so that caches never share a cache line */
+    struct alignas(POOL_CACHE_LINE) Cache {
+        Node*    head;  // Objects handed out by request()
+        Node*    full;  // A complete batch kept in reserve before spilling to the shared list
+        unsigned count; // Objects in 'head'
+    };
+
+    /** Header at the start of each slab */
+    struct Slab {
+        Slab* next;
+    };
+
+    static const unsigned BATCH = 32;
+    static const unsigned TAG_SHIFT = sizeof(void*) == 8 ? 48 : 32;
+
+    Cache caches[POOL_MAX_THREADS];
+
+    // Shared list, written by all threads, on a cache line of its own
+    alignas(POOL_CACHE_LINE) std::atomic<std::uint64_t> shared;
+
+    // Threads without a slot share this cache
+    alignas(POOL_CACHE_LINE) std::mutex overflowLock;
+    Cache      overflow;
+
+    // Slab allocation
+    std::mutex   growLock;
+    Slab*        slabs;
+    PoolBacking* backing;
+    PoolGrowth   growth;
+    unsigned     lastGrowth;
+
+    /** Alignment of objects (and of slabs) */
+    static std::size_t alignment ()
+    {
+        std::size_t a = alignof(C) > alignof(Node) ? alignof(C) : alignof(Node);
+        return Align > a ? Align : a;
+    }
+
+    /** Bytes between neighbouring objects */
+    static std::size_t stride ()
+    {
+        return poolRoundUp(sizeof(C) > sizeof(Node) ? sizeof(C) : sizeof(Node), alignment());
+    }
+
+    static std::size_t slabBytes ()
+    {
+        return poolSlabBytes(stride());
+    }
+
+    /** Offset of the first object in a slab */
+    static std::size_t slabHeader ()
+    {
+        return poolRoundUp(sizeof(Slab), alignment());
+    }
+
+    static Node* unpack (std::uint64_t v)
+    {
+        return (Node*)(std::uintptr_t)(v & ((std::uint64_t(1) << TAG_SHIFT) - 1));
+    }
+
+    static std::uint64_t pack (Node* n, std::uint64_t old)
+    {
+        return (std::uint64_t)(std::uintptr_t)n | (((old >> TAG_SHIFT) + 1) << TAG_SHIFT);
+    }
+
+    /** Push a chain of batches (first .. last, linked through 'batch') onto the shared list */
+    void pushShared (Node* first, Node* last)
+    {
+        std::uint64_t old = shared.load(std::memory_order_relaxed);
+        do {
+            last->batch.store(unpack(old), std::memory_order_relaxed);
+        } while (!shared.compare_exchange_weak(old, pack(first, old), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /** Pop a batch from the shared list, or return 0 if it is empty */
+    Node* popShared ()
+    {
+        std::uint64_t old = shared.load(std::memory_order_acquire);
+        Node* top;
+        while ((top = unpack(old)) != 0)
+        {
+            // 'top' may be popped and reused by another thread before the
+            // exchange, in which case the tag no longer matches and we retry.
+            Node* next = top->batch.load(std::memory_order_relaxed);
+            if (shared.compare_exchange_weak(old, pack(next, old), std::memory_order_acquire, std::memory_order_acquire))
+            {
+                return top;
+            }
+        }
+        return 0;
+    }
+
+    /** Allocate slabs, keep one batch and put the rest on the shared list */
+    Node* grow ()
+    {
+        std::lock_guard<std::mutex> guard(growLock);
+
+        // Another thread may have refilled the shared list while we waited
+        Node* batch = popShared();
+        if (batch)
+        {
+            return batch;
+        }
+
+        lastGrowth = growth.next(lastGrowth);
+        const std::size_t bytes = slabBytes();
+        const std::size_t step  = stride();
+        const std::size_t count = (bytes - slabHeader()) / step;
+
+        Node* first = 0;
+        Node* last  = 0;
+        for (unsigned s = 0; s < lastGrowth; ++s)
+        {
+            Slab* slab = (Slab*)backing->allocate(bytes);
+            onAlloc(int(bytes));
+            slab->next = slabs;
+            slabs = slab;
+
+            // Cut the slab into batches, each linked in address order
+            char* base = (char*)slab + slabHeader();
+            for (std::size_t i = 0; i < count; i += BATCH)
+            {
+                std::size_t n = count - i < BATCH ? count - i : BATCH;
+                Node* head = (Node*)(base + i * step);
+                for (std::size_t j = 0; j < n; ++j)
+                {
+                    Node* node = new(base + (i + j) * step) Node;
+                    node->next = j + 1 < n ? (Node*)(base + (i + j + 1) * step) : 0;
+                }
+                head->count = unsigned(n);
+                head->batch.store(0, std::memory_order_relaxed);
+                if (last)
+                {
+                    last->batch.store(head, std::memory_order_relaxed);
+                } else
+                {
+                    first = head;
+                }
+                last = head;
+            }
+        }
+
+        batch = first;
+        first = first->batch.load(std::memory_order_relaxed);
+        if (first)
+        {
+            pushShared(first, last);
+        }
+        return batch;
+    }
+
+    Node* take (Cache& cache)
+    {
+        if (cache.head == 0)
+        {
+            if (cache.full)
+            {
+                // Use the reserve batch
+                cache.head  = cache.full;
+                cache.count = cache.full->count;
+                cache.full  = 0;
+            } else
+            {
+                // Refill from the shared list, or allocate
+                Node* batch = popShared();
+                if (batch == 0)
+                {
+                    batch = grow();
+                }
+                cache.head  = batch;
+                cache.count = batch->count;
+            }
+        }
+        Node* temp = cache.head;
+        cache.head = temp->next;
+        --cache.count;
+        return temp;
+    }
+
+    void give (Cache& cache, Node* node)
+    {
+        node->next = cache.head;
+        cache.head = node;
+        if (++cache.count == BATCH)
+        {
+            // The current list is a complete batch, move it to the reserve
+            // and spill the previous reserve to the shared list.
+            node->count = BATCH;
+            if (cache.full)
+            {
+                pushShared(cache.full, cache.full);
+            }
+            cache.full  = node;
+            cache.head  = 0;
+            cache.count = 0;
+        }
+    }
+
+    static void clear (Cache& cache)
+    {
+        cache.head  = 0;
+        cache.count = 0;
+        cache.full  = 0;
+    }
+
+public:
+    ConcurrentMemoryPool () : shared(0), slabs(0), backing(&poolDefaultBacking()), growth(PoolGrowth::capped(1, 64)), lastGrowth(0)
+    {
+        for (unsigned i = 0; i < POOL_MAX_THREADS; ++i)
+        {
+            clear(caches[i]);
+        }
+        clear(overflow);
+    }
+
+    ConcurrentMemoryPool (PoolGrowth g, PoolWatcher* w=0) : shared(0), slabs(0), backing(&poolDefaultBacking()), growth(g), lastGrowth(0)
+    {
+        for (unsigned i = 0; i < POOL_MAX_THREADS; ++i)
+        {
+            clear(caches[i]);
+        }
+        clear(overflow);
+        if (w)
+        {
+            addWatcher(w);
+        }
+    }
+
+    ConcurrentMemoryPool (PoolGrowth g, PoolBacking& b, PoolWatcher* w=0) : shared(0), slabs(0), backing(&b), growth(g), lastGrowth(0)
+    {
+        for (unsigned i = 0; i < POOL_MAX_THREADS; ++i)
+        {
+            clear(caches[i]);
+        }
+        clear(overflow);
+        if (w)
+        {
+            addWatcher(w);
+        }
+    }
+
+    /**
+     * Free all slabs. No other thread may be using the pool.
+     * Objects which were not released are not destructed, but their memory is freed.
+     */
+    ~ConcurrentMemoryPool ()
+    {
+        int num = 0;
+        Slab* temp;
+        while (slabs != 0)
+        {
+            temp = slabs;
+            slabs = slabs->next;
+            backing->deallocate(temp, slabBytes());
+            ++num;
+        }
+        onFree(int(slabBytes() * num));
+    }
+
+    /**
+     * The members above are cache line aligned, which plain new only honours
+     * from C++17 on, so pools allocated on the heap get aligned storage here.
+     */
+    static void* operator new (std::size_t bytes)
+    {
+        return poolAlignedAlloc(bytes, alignof(ConcurrentMemoryPool));
+    }
+
+    static void* operator new[] (std::size_t bytes)
+    {
+        return poolAlignedAlloc(bytes, alignof(ConcurrentMemoryPool));
+    }
+
+    static void* operator new (std::size_t, void* where) noexcept
+    {
+        return where;
+    }
+
+    static void operator delete (void* p) noexcept
+    {
+        poolAlignedFree(p);
+    }
+
+    static void operator delete[] (void* p) noexcept
+    {
+        poolAlignedFree(p);
+    }
+
+    static void operator delete (void*, void*) noexcept
+    {
+    }
+
+    /** Add a watcher to be notified of memory management events. Not thread safe. */
+    void addWatcher (PoolWatcher* w)
+    {
+        add(w);
+    }
+
+    unsigned objectSize () const
+    {
+        return sizeof(C);
+    }
+
+    /** Request the construction of a new object */
+    C* request ()
+    {
+        Node* temp;
+        unsigned slot = poolThreadSlot();
+        if (slot != POOL_NO_SLOT)
+        {
+            temp = take(caches[slot]);
+        } else
+        {
+            std::lock_guard<std::mutex> guard(overflowLock);
+            temp = take(overflow);
+        }
+
+        // Construct object
+        C* c;
+        try {
+            c = new(temp) C;
+        } catch (...) {
+            // Put the node back if the constructor throws
+            temp = new((void*)temp) Node;
+            if (slot != POOL_NO_SLOT)
+            {
+                give(caches[slot], temp);
+            } else
+            {
+                std::lock_guard<std::mutex> guard(overflowLock);
+                give(overflow, temp);
+            }
+            throw;
+        }
+
+        // Notify watchers once the object exists
+        onRequest(c, sizeof(C));
+        return c;
+    }
+
+    /** Release and destruct an object, from any thread */
+    void release (const C* const c)
+    {
+        c->~C();
+        Node* temp = new((void*)c) Node;
+
+        onRelease(temp, sizeof(C));
+
+        unsigned slot = poolThreadSlot();
+        if (slot != POOL_NO_SLOT)
+        {
+            give(caches[slot], temp);
+        } else
+        {
+            std::lock_guard<std::mutex> guard(overflowLock);
+            give(overflow, temp);
+        }
+    }
+
+    void* req ()
+    {
+        return (void*)request();
+    }
+
+    void rel(void* o)
+    {
+        release((const C* const)o);
+    }
+};
+
+#endif // CONCURRENTMEMORYPOOL_H
@@ -0,0 +1,248 @@
+#ifndef HANDLEPOOL_H
+#define HANDLEPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+/***** Sample Usage:
+ * HandlePool<Foo> fooPool;
+ * HandlePool<Foo>::Handle h = fooPool.request(1, 2);
+ * fooPool.get(h)->bar();          // Unchecked, a single indexed load
+ * ...
+ * fooPool.release(h);
+ * fooPool.lookup(h);              // 0, the handle is stale
+ *****/
+
+/**
+ * HandlePool
+ *
+ * Pool which hands out 32 bit handles instead of pointers. The low
+ * IndexBits bits of a handle index a slot in contiguous storage, and the
+ * remaining bits hold the slot's generation when the handle was made.
+ * Releasing a slot bumps its generation, so handles to released objects are
+ * caught with one comparison.
+ *
+ * Like MemoryPool, unused slots are kept in a free list, linked through the
+ * storage of the unused objects themselves.
+ *
+ * Storage grows by doubling and moves the live objects, so pointers from
+ * get() are only valid until the next request(); handles stay valid.
+ * At most 2^IndexBits objects can be live, and a slot's generation wraps
+ * after 2^(31 - IndexBits) reuses.
+ */
+template <class C, unsigned IndexBits = 24> class HandlePool
+{
+private:
+    static_assert(IndexBits > 0 && IndexBits < 31, "HandlePool needs at least one generation bit besides the live bit");
+
+    static const std::uint32_t INDEX_MASK = (std::uint32_t(1) << IndexBits) - 1;
+    static const std::uint32_t GEN_MASK   = ~std::uint32_t(0) >> IndexBits;
+    static const std::uint32_t NONE       = ~std::uint32_t(0);
+
+    /** Storage of one object, or the link to the next unused slot */
+    union Slot {
+        alignas(C) unsigned char object[sizeof(C)];
+        std::uint32_t            nextUnused;
+    };
+
+public:
+    /** Reference to an object in a HandlePool. The default handle is never valid. */
+    struct Handle {
+        std::uint32_t bits;
+
+        Handle () : bits(0) {}
+        explicit Handle (std::uint32_t b) : bits(b) {}
+
+        std::uint32_t index () const
+        {
+            return bits & INDEX_MASK;
+        }
+
+        std::uint32_t generation () const
+        {
+            return bits >> IndexBits;
+        }
+
+        bool operator== (Handle h) const
+        {
+            return bits == h.bits;
+        }
+
+        bool operator!= (Handle h) const
+        {
+            return bits != h.bits;
+        }
+    };
+
+private:
+    Slot*          slots;
+    std::uint32_t* gens;     // Generation of each slot, odd while the slot is live
+    std::uint32_t  used;     // Slots ever handed out; beyond this, slots were never used
+    std::uint32_t  capacity;
+    std::uint32_t  unused;   // First unused slot below 'used', or NONE
+    std::uint32_t  live;
+
+    bool isLive (std::uint32_t i) const
+    {
+        return (gens[i] & 1) != 0;
+    }
+
+    C* object (std::uint32_t i) const
+    {
+        return (C*)slots[i].object;
+    }
+
+    /** Move everything into storage for cap slots */
+    void grow (std::uint32_t cap)
+    {
+        Slot* s = (Slot*)std::malloc(sizeof(Slot) * cap);
+        std::uint32_t* g = (std::uint32_t*)std::malloc(sizeof(std::uint32_t) * cap);
+        if (s == 0 || g == 0)
+        {
+            std::free(s);
+            std::free(g);
+            throw std::bad_alloc();
+        }
+        for (std::uint32_t i = 0; i < used; ++i)
+        {
+            g[i] = gens[i];
+            if (isLive(i))
+            {
+                new(s[i].object) C(std::move(*object(i)));
+                object(i)->~C();
+            } else
+            {
+                s[i].nextUnused = slots[i].nextUnused;
+            }
+        }
+        std::free(slots);
+        std::free(gens);
+        slots = s;
+        gens = g;
+        capacity = cap;
+    }
+
+    /** Take an unused slot, growing the storage if there are none */
+    std::uint32_t take ()
+    {
+        if (unused != NONE)
+        {
+            std::uint32_t i = unused;
+            unused = slots[i].nextUnused;
+            return i;
+        }
+        if (used == capacity)
+        {
+            if (capacity > INDEX_MASK)
+            {
+                throw std::bad_alloc();
+            }
+            std::uint32_t cap = capacity ? capacity * 2 : 64;
+            grow(cap - 1 > INDEX_MASK ? INDEX_MASK + 1 : cap);
+        }
+        gens[used] = 0;
+        return used++;
+    }
+
+public:
+    HandlePool () : slots(0), gens(0), used(0), capacity(0), unused(NONE), live(0)
+    {
+    }
+
+    HandlePool (std::uint32_t num) : slots(0), gens(0), used(0), capacity(0), unused(NONE), live(0)
+    {
+        reserve(num);
+    }
+
+    HandlePool (const HandlePool&) = delete;
+    HandlePool& operator= (const HandlePool&) = delete;
+
+    /** Destruct the objects which were not released, and free the storage */
+    ~HandlePool ()
+    {
+        for (std::uint32_t i = 0; i < used; ++i)
+        {
+            if (isLive(i))
+            {
+                object(i)->~C();
+            }
+        }
+        std::free(slots);
+        std::free(gens);
+    }
+
+    /** Make room for num objects without moving the storage again */
+    void reserve (std::uint32_t num)
+    {
+        if (num > INDEX_MASK + 1)
+        {
+            num = INDEX_MASK + 1;
+        }
+        if (num > capacity)
+        {
+            grow(num);
+        }
+    }
+
+    /** Construct an object from args and return a handle to it */
+    template <class... Args> Handle request (Args&&... args)
+    {
+        std::uint32_t i = take();
+        try {
+            new(slots[i].object) C(std::forward<Args>(args)...);
+        } catch (...) {
+            slots[i].nextUnused = unused;
+            unused = i;
+            throw;
+        }
+        ++gens[i];
+        ++live;
+        return Handle(i | ((gens[i] & GEN_MASK) << IndexBits));
+    }
+
+    /** Destruct the object of h. Returns false, doing nothing, if h is stale. */
+    bool release (Handle h)
+    {
+        if (!valid(h))
+        {
+            return false;
+        }
+        std::uint32_t i = h.index();
+        object(i)->~C();
+        ++gens[i];
+        slots[i].nextUnused = unused;
+        unused = i;
+        --live;
+        return true;
+    }
+
+    /** True if h refers to a live object */
+    bool valid (Handle h) const
+    {
+        std::uint32_t i = h.index();
+        return i < used && (gens[i] & GEN_MASK) == h.generation() && isLive(i);
+    }
+
+    /** The object of h, which must be valid */
+    C* get (Handle h) const
+    {
+        return object(h.index());
+    }
+
+    /** The object of h, or 0 if h is stale */
+    C* lookup (Handle h) const
+    {
+        return valid(h) ? object(h.index()) : 0;
+    }
+
+    /** Objects requested and not yet released */
+    std::uint32_t size () const
+    {
+        return live;
+    }
+};
+
+#endif // HANDLEPOOL_H
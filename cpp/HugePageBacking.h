@@ -0,0 +1,231 @@
+#ifndef HUGEPAGEBACKING_H
+#define HUGEPAGEBACKING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+#include "MemoryPool.h"
+
+/***** Sample Usage:
+ * HugePageBacking backing;                    // Must outlive the pool
+ * MemoryPool<Foo> fooPool(1000000, PoolGrowth::capped(1, 64), backing);
+ *****/
+
+/** Size of a huge page on x86-64 and AArch64 with 4KB pages */
+const std::size_t POOL_HUGE_PAGE = 2 * 1024 * 1024;
+
+/**
+ * HugePageBacking
+ *
+ * Pool backing which maps large regions of anonymous memory, aligned to
+ * huge pages, and carves slabs out of them. Packing many slabs into each
+ * huge page cuts TLB misses on large pools. The regions show up in
+ * /proc/self/smaps, named "MemoryPool" where the kernel allows it.
+ *
+ * Modes:
+ *      TRANSPARENT: normal pages, advised with MADV_HUGEPAGE so that the
+ *                   kernel can back them with transparent huge pages
+ *      EXPLICIT:    pages from the hugetlbfs pool (MAP_HUGETLB). Falls back to
+ *                   TRANSPARENT for good if no huge pages are reserved.
+ *
+ * Freed slabs are given back to the OS with MADV_DONTNEED and kept for
+ * reuse; regions are only unmapped when the backing is destroyed. Hugetlbfs
+ * memory can only be given back in whole, aligned huge pages, and not at all
+ * before Linux 5.18, so in EXPLICIT mode smaller freed slabs stay resident
+ * until the backing is destroyed. retainedBytes() reports how much.
+ * Thread safe.
+ */
+class HugePageBacking : public PoolBacking
+{
+public:
+    enum Mode { TRANSPARENT, EXPLICIT };
+
+private:
+    struct Region {
+        char*       base;
+        std::size_t bytes;
+    };
+
+    /** A freed slab, and whether its memory could not be given back */
+    struct Spare {
+        void* slab;
+        bool  resident;
+    };
+
+    Mode        mode;
+    std::size_t regionBytes;
+    bool        hugeFailed;
+
+    std::mutex lock;
+    std::vector<Region> regions;
+    char* cursor;   // Next free byte of the newest region
+    char* limit;    // End of the newest region
+
+    // Slabs freed, by size
+    std::map<std::size_t, std::vector<Spare> > unused;
+    std::size_t retained;   // Bytes of freed slabs still resident
+
+    /**
+     * Map bytes aligned to align, or return 0. Both must be multiples of
+     * POOL_HUGE_PAGE, and align a power of two.
+     */
+    char* map (std::size_t bytes, std::size_t align)
+    {
+        if (mode == EXPLICIT && !hugeFailed)
+        {
+            // Huge page mappings are huge page aligned, so only map extra for larger alignments
+            std::size_t extra = align - POOL_HUGE_PAGE;
+            char* p = (char*)mmap(0, bytes + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != (char*)MAP_FAILED)
+            {
+                char* base = trim(p, bytes, extra, align);
+                name(base, bytes);
+                return base;
+            }
+            hugeFailed = true;
+        }
+
+        char* p = (char*)mmap(0, bytes + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == (char*)MAP_FAILED)
+        {
+            return 0;
+        }
+        char* base = trim(p, bytes, align, align);
+#if defined(MADV_HUGEPAGE)
+        madvise(base, bytes, MADV_HUGEPAGE);
+#endif
+        name(base, bytes);
+        return base;
+    }
+
+    /** Unmap the unaligned ends of bytes + extra mapped at p, and return the aligned start */
+    static char* trim (char* p, std::size_t bytes, std::size_t extra, std::size_t align)
+    {
+        char* base = (char*)poolRoundUp((std::uintptr_t)p, align);
+        if (base > p)
+        {
+            munmap(p, base - p);
+        }
+        if (base + bytes < p + bytes + extra)
+        {
+            munmap(base + bytes, (p + bytes + extra) - (base + bytes));
+        }
+        return base;
+    }
+
+    static void name (char* base, std::size_t bytes)
+    {
+#if defined(PR_SET_VMA) && defined(PR_SET_VMA_ANON_NAME)
+        prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, (unsigned long)base, bytes, (unsigned long)"MemoryPool");
+#else
+        (void)base;
+        (void)bytes;
+#endif
+    }
+
+public:
+    /** regionBytes is rounded up to a multiple of POOL_HUGE_PAGE */
+    HugePageBacking (Mode m=TRANSPARENT, std::size_t regionBytes=16 * POOL_HUGE_PAGE)
+        : mode(m), regionBytes(poolRoundUp(regionBytes ? regionBytes : 1, POOL_HUGE_PAGE)), hugeFailed(false), cursor(0), limit(0), retained(0)
+    {
+    }
+
+    HugePageBacking (const HugePageBacking&) = delete;
+    HugePageBacking& operator= (const HugePageBacking&) = delete;
+
+    /** Unmap every region. No pool may still be using the backing. */
+    ~HugePageBacking ()
+    {
+        for (std::size_t i = 0; i < regions.size(); ++i)
+        {
+            munmap(regions[i].base, regions[i].bytes);
+        }
+    }
+
+    /** True if slabs are coming from explicitly reserved huge pages */
+    bool explicitHugePages ()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return mode == EXPLICIT && !hugeFailed;
+    }
+
+    /** Bytes of freed slabs the OS could not take back, which stay resident until reused */
+    std::size_t retainedBytes ()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return retained;
+    }
+
+    void* allocate (std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        // Reuse a freed slab of the same size
+        std::vector<Spare>& spare = unused[bytes];
+        if (!spare.empty())
+        {
+            Spare s = spare.back();
+            spare.pop_back();
+            if (s.resident)
+            {
+                retained -= bytes;
+            }
+            return s.slab;
+        }
+
+        // Slabs larger than a region get a region of their own
+        if (bytes > regionBytes)
+        {
+            std::size_t size = poolRoundUp(bytes, POOL_HUGE_PAGE);
+            char* p = map(size, bytes > POOL_HUGE_PAGE ? bytes : POOL_HUGE_PAGE);
+            if (p == 0)
+            {
+                throw std::bad_alloc();
+            }
+            Region r = {p, size};
+            regions.push_back(r);
+            return p;
+        }
+
+        // Carve from the newest region, starting a new one when it is full.
+        // The region is aligned to the slab too, as slabs larger than a huge page must be.
+        char* slab = (char*)poolRoundUp((std::uintptr_t)cursor, bytes);
+        if (cursor == 0 || slab + bytes > limit)
+        {
+            char* p = map(regionBytes, bytes > POOL_HUGE_PAGE ? bytes : POOL_HUGE_PAGE);
+            if (p == 0)
+            {
+                throw std::bad_alloc();
+            }
+            Region r = {p, regionBytes};
+            regions.push_back(r);
+            limit = p + regionBytes;
+            slab = (char*)poolRoundUp((std::uintptr_t)p, bytes);
+        }
+        cursor = slab + bytes;
+        return slab;
+    }
+
+    void deallocate (void* slab, std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        // Fails on hugetlbfs memory unless the slab is whole, aligned huge pages
+        Spare s = {slab, madvise(slab, bytes, MADV_DONTNEED) != 0};
+        if (s.resident)
+        {
+            retained += bytes;
+        }
+        unused[bytes].push_back(s);
+    }
+};
+
+#endif // HUGEPAGEBACKING_H
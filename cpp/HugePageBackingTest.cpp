@@ -0,0 +1,89 @@
+/**
+ * Checks that HugePageBacking hands out slabs aligned to their own size,
+ * which MemoryPool and Colony rely on to find a slab from an object in it.
+ * Slabs larger than a huge page are the ones at risk.
+ *
+ * Build and run:
+ *      g++ -std=c++11 -O2 -pthread HugePageBackingTest.cpp -o HugePageBackingTest
+ *      ./HugePageBackingTest
+ *
+ * Prints each failure and exits with 1 if there were any.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "HugePageBacking.h"
+#include "MemoryPool.h"
+
+int failures = 0;
+
+void check (bool ok, const char* what, const char* mode, std::size_t bytes)
+{
+    if (!ok)
+    {
+        std::printf("FAIL %-11s %8zu KB slabs: %s\n", mode, bytes / 1024, what);
+        ++failures;
+    }
+}
+
+// Objects big enough that MemoryPool picks 4MB slabs.
+struct Big
+{
+    char bytes[400 * 1024];
+};
+
+void testMode (HugePageBacking::Mode mode, const char* name)
+{
+    // Mixed sizes from one backing, so that regions are shared and later slabs start mid region
+    const std::size_t sizes[] = { 65536, POOL_HUGE_PAGE, 2 * POOL_HUGE_PAGE, 4 * POOL_HUGE_PAGE, 65536, 2 * POOL_HUGE_PAGE };
+    HugePageBacking backing(mode);
+    std::vector<std::pair<void*, std::size_t> > slabs;
+    for (int round = 0; round < 4; ++round)
+    {
+        for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+        {
+            std::size_t bytes = sizes[i];
+            char* slab = (char*)backing.allocate(bytes);
+            check(((std::uintptr_t)slab & (bytes - 1)) == 0, "slab not aligned to its size", name, bytes);
+            std::memset(slab, round, 1);
+            std::memset(slab + bytes - 1, round, 1);
+            slabs.push_back(std::make_pair((void*)slab, bytes));
+        }
+    }
+    // Freed slabs come back aligned too
+    for (std::size_t i = 0; i < slabs.size(); ++i)
+    {
+        backing.deallocate(slabs[i].first, slabs[i].second);
+    }
+    for (std::size_t i = 0; i < slabs.size(); ++i)
+    {
+        std::size_t bytes = slabs[i].second;
+        void* slab = backing.allocate(bytes);
+        check(((std::uintptr_t)slab & (bytes - 1)) == 0, "reused slab not aligned to its size", name, bytes);
+    }
+
+    // A pool with slabs larger than a huge page finds the owner of every object
+    HugePageBacking poolBacking(mode);
+    MemoryPool<Big> pool(0, PoolGrowth::capped(1, 64), poolBacking);
+    std::vector<Big*> objects;
+    for (int i = 0; i < 64; ++i)
+    {
+        objects.push_back(pool.request());
+    }
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        check(MemoryPool<Big>::owner(objects[i]) == &pool, "pool object not found from its slab", name, poolSlabBytes(sizeof(Big)));
+        pool.release(objects[i]);
+    }
+}
+
+int main ()
+{
+    testMode(HugePageBacking::TRANSPARENT, "transparent");
+    testMode(HugePageBacking::EXPLICIT, "explicit");
+    std::printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -1,13 +1,37 @@
 #ifndef MEMORYPOOL_H
 #define MEMORYPOOL_H
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
 /***** Sample Usage:
  * Pool<Foo> fooPool;
  * Foo* foo = fooPool.request();
  * ...
  * Pool.release(foo);
+ *
+ * // Each counter on its own cache line
+ * MemoryPool<Counter, POOL_CACHE_LINE> counterPool;
+ *
+ * // Construct in place, released when the handle goes out of scope
+ * MemoryPool<Bar> barPool;
+ * pool_ptr<Bar> bar = barPool.make(1, "bar");
  *****/
 
+/** Size of a cache line, for pools whose objects must not share one */
+const std::size_t POOL_CACHE_LINE = 64;
+
 /**
  * PoolWatcher
  *
@@ -31,17 +55,372 @@ public:
     virtual void onRequest (void* obj)=0;
     /** An object was released back to the pool */
     virtual void onRelease (void* obj)=0;
+
+    /** A batch of n objects was requested from the pool */
+    virtual void onRequestN (void* const* objs, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            onRequest(objs[i]);
+        }
+    }
+
+    /** A batch of n objects was released back to the pool */
+    virtual void onReleaseN (void* const* objs, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            onRelease(objs[i]);
+        }
+    }
+};
+
+/**
+ * Watch policies
+ *
+ * Decide at compile time how a MemoryPool reports memory events:
+ *      PoolWatchNone:      not at all, every hook compiles away
+ *      PoolWatchOccupancy: not at all, but the pool counts live objects
+ *      PoolWatchCounters:  by counting them, without callbacks
+ *      PoolWatchCallbacks: by calling each PoolWatcher added to the pool
+ *
+ * Watchers added to a pool whose policy has no callbacks are ignored.
+ * Request and release hooks are also given the size of each object, for
+ * policies which need it (see PoolWatchSampled in PoolProfiler.h).
+ *
+ * TRACK_LIVE says whether the pool keeps its live and peak object counts
+ * up to date on every request and release. Without them, as with
+ * PoolWatchNone, request() and release() are a bare free list pop and
+ * push, but stats() and trim() count the unused objects instead, peak is
+ * not known, and decay() cannot be used.
+ */
+struct PoolWatchNone
+{
+    static const bool TRACK_LIVE = false;
+
+    void add       (PoolWatcher*) {}
+    void onAlloc   (int) {}
+    void onFree    (int) {}
+    void onRequest (void*, std::size_t) {}
+    void onRelease (void*, std::size_t) {}
+    void onRequestN (void* const*, std::size_t, std::size_t) {}
+    void onReleaseN (void* const*, std::size_t, std::size_t) {}
 };
 
-#define CALL_WATCHERS(func)         \
-        if (watcher)                \
-        {                           \
-            Watcher* w = watcher;   \
-            do {                    \
-                w->watcher->func;   \
-                w = w->next;        \
-            } while (w);            \
+struct PoolWatchOccupancy : PoolWatchNone
+{
+    static const bool TRACK_LIVE = true;
+};
+
+struct PoolWatchCounters
+{
+    static const bool TRACK_LIVE = true;
+
+    unsigned long allocated; // Bytes allocated from the heap
+    unsigned long freed;     // Bytes freed to the heap
+    unsigned long requests;  // Objects requested
+    unsigned long releases;  // Objects released
+
+    PoolWatchCounters () : allocated(0), freed(0), requests(0), releases(0) {}
+
+    void add       (PoolWatcher*) {}
+    void onAlloc   (int bytes) { allocated += bytes; }
+    void onFree    (int bytes) { freed += bytes; }
+    void onRequest (void*, std::size_t) { ++requests; }
+    void onRelease (void*, std::size_t) { ++releases; }
+    void onRequestN (void* const*, std::size_t n, std::size_t) { requests += n; }
+    void onReleaseN (void* const*, std::size_t n, std::size_t) { releases += n; }
+
+    /** Objects requested and not yet released */
+    unsigned long live () const
+    {
+        return requests - releases;
+    }
+};
+
+class PoolWatchCallbacks
+{
+private:
+    struct Watcher {
+        Watcher*     next;
+        PoolWatcher* watcher;
+    }* watcher;
+
+public:
+    static const bool TRACK_LIVE = true;
+
+    PoolWatchCallbacks () : watcher(0) {}
+    PoolWatchCallbacks (const PoolWatchCallbacks&) = delete;
+    PoolWatchCallbacks& operator= (const PoolWatchCallbacks&) = delete;
+
+    /** Remove watchers (memory for watcher is not freed here) */
+    ~PoolWatchCallbacks ()
+    {
+        Watcher* w;
+        while (watcher)
+        {
+            w = watcher;
+            watcher = watcher->next;
+            delete w;
+        }
+    }
+
+    void add (PoolWatcher* w)
+    {
+        Watcher* watch = new Watcher;
+        watch->watcher = w;
+        watch->next = watcher;
+        watcher = watch;
+    }
+
+    void onAlloc (int bytes)
+    {
+        for (Watcher* w = watcher; w; w = w->next)
+        {
+            w->watcher->onAlloc(bytes);
+        }
+    }
+
+    void onFree (int bytes)
+    {
+        for (Watcher* w = watcher; w; w = w->next)
+        {
+            w->watcher->onFree(bytes);
+        }
+    }
+
+    void onRequest (void* obj, std::size_t)
+    {
+        for (Watcher* w = watcher; w; w = w->next)
+        {
+            w->watcher->onRequest(obj);
+        }
+    }
+
+    void onRelease (void* obj, std::size_t)
+    {
+        for (Watcher* w = watcher; w; w = w->next)
+        {
+            w->watcher->onRelease(obj);
+        }
+    }
+
+    void onRequestN (void* const* objs, std::size_t n, std::size_t)
+    {
+        for (Watcher* w = watcher; w; w = w->next)
+        {
+            w->watcher->onRequestN(objs, n);
+        }
+    }
+
+    void onReleaseN (void* const* objs, std::size_t n, std::size_t)
+    {
+        for (Watcher* w = watcher; w; w = w->next)
+        {
+            w->watcher->onReleaseN(objs, n);
+        }
+    }
+};
+
+/**
+ * PoolGrowth
+ *
+ * Decides how many slabs a pool allocates when it runs out of free objects.
+ *      FIXED:     always allocate the same number of slabs
+ *      GEOMETRIC: double the number of slabs on every refill
+ *      CAPPED:    double the number of slabs, but never beyond a limit
+ */
+struct PoolGrowth
+{
+    enum Mode { FIXED, GEOMETRIC, CAPPED };
+
+    Mode     mode;
+    unsigned slabs; // Slabs allocated by the first refill
+    unsigned limit; // Largest refill, only used by CAPPED
+
+    static PoolGrowth fixed (unsigned slabs)
+    {
+        PoolGrowth g = {FIXED, slabs, slabs};
+        return g;
+    }
+
+    static PoolGrowth geometric (unsigned slabs)
+    {
+        PoolGrowth g = {GEOMETRIC, slabs, 0};
+        return g;
+    }
+
+    static PoolGrowth capped (unsigned slabs, unsigned limit)
+    {
+        PoolGrowth g = {CAPPED, slabs, limit};
+        return g;
+    }
+
+    /** Number of slabs to allocate on the refill after one of 'last' slabs */
+    unsigned next (unsigned last) const
+    {
+        if (mode == FIXED || last == 0)
+        {
+            return slabs > 0 ? slabs : 1;
+        }
+        unsigned n = last * 2;
+        if (n < last)
+        {
+            // Overflow
+            n = last;
         }
+        if (mode == CAPPED && n > limit)
+        {
+            n = limit > 0 ? limit : 1;
+        }
+        return n;
+    }
+};
+
+/** Smallest power of two slab holding at least 64KB and at least 8 objects */
+inline std::size_t poolSlabBytes (std::size_t stride)
+{
+    std::size_t bytes = 65536;
+    while (bytes < stride * 8)
+    {
+        bytes *= 2;
+    }
+    return bytes;
+}
+
+/** Round n up to a multiple of align */
+inline std::size_t poolRoundUp (std::size_t n, std::size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+/** Allocate bytes aligned to align, which must be a power of two. Throws std::bad_alloc on failure. */
+inline void* poolAlignedAlloc (std::size_t bytes, std::size_t align)
+{
+    if (align < sizeof(void*))
+    {
+        align = sizeof(void*);
+    }
+#if defined(_WIN32)
+    void* p = _aligned_malloc(bytes, align);
+#else
+    void* p = 0;
+    if (posix_memalign(&p, align, bytes) != 0)
+    {
+        p = 0;
+    }
+#endif
+    if (p == 0)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+/** Free memory from poolAlignedAlloc */
+inline void poolAlignedFree (void* p)
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+/**
+ * Allocate a slab of bytes aligned to its own size, which must be a power of
+ * two. Slabs are mapped straight from the OS where possible, so that
+ * poolSlabFree() gives the memory back rather than leaving it in the heap.
+ * Throws std::bad_alloc on failure.
+ */
+inline void* poolSlabAlloc (std::size_t bytes)
+{
+#if defined(_WIN32)
+    return poolAlignedAlloc(bytes, bytes);
+#else
+    // Map twice the size and unmap the unaligned ends
+    char* p = (char*)mmap(0, bytes * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == (char*)MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    char* slab = (char*)poolRoundUp((std::uintptr_t)p, bytes);
+    if (slab > p)
+    {
+        munmap(p, slab - p);
+    }
+    if (slab + bytes < p + bytes * 2)
+    {
+        munmap(slab + bytes, (p + bytes * 2) - (slab + bytes));
+    }
+    return slab;
+#endif
+}
+
+/** Give a slab from poolSlabAlloc back to the OS */
+inline void poolSlabFree (void* slab, std::size_t bytes)
+{
+#if defined(_WIN32)
+    (void)bytes;
+    poolAlignedFree(slab);
+#else
+    munmap(slab, bytes);
+#endif
+}
+
+/**
+ * PoolBacking
+ *
+ * Where pools get their slabs from. Slabs are a power of two bytes in size,
+ * and must be aligned to their own size.
+ *
+ * A backing must outlive every pool using it, and must be thread safe if
+ * pools on different threads share it.
+ */
+class PoolBacking
+{
+public:
+    virtual ~PoolBacking () {}
+
+    /** Allocate a slab of bytes, aligned to bytes. Throws std::bad_alloc on failure. */
+    virtual void* allocate (std::size_t bytes)=0;
+
+    /** Free a slab from allocate() */
+    virtual void  deallocate (void* slab, std::size_t bytes)=0;
+};
+
+/** Backing which maps each slab from the OS on its own, with poolSlabAlloc() */
+class PoolPageBacking : public PoolBacking
+{
+public:
+    void* allocate (std::size_t bytes)
+    {
+        return poolSlabAlloc(bytes);
+    }
+
+    void deallocate (void* slab, std::size_t bytes)
+    {
+        poolSlabFree(slab, bytes);
+    }
+};
+
+/** Backing of pools which are not given one. It is never destroyed, so it outlives static pools. */
+inline PoolBacking& poolDefaultBacking ()
+{
+    static typename std::aligned_storage<sizeof(PoolPageBacking), alignof(PoolPageBacking)>::type storage;
+    static PoolBacking* backing = new(&storage) PoolPageBacking;
+    return *backing;
+}
+
+/** Object counts of a pool */
+struct PoolStats
+{
+    std::size_t live;  // Objects requested and not yet released
+    std::size_t peak;  // Most objects live at once
+    std::size_t free;  // Objects ready to be requested without allocating
+    std::size_t slabs; // Slabs held by the pool
+    std::size_t bytes; // Bytes held by the pool
+};
 
 /**
   *
@@ -62,8 +441,28 @@ public:
 
     /** */
     virtual void  rel(void*)=0;
+
+    /** Request n objects into out. Pools which can do better than one req() per object override this. */
+    virtual void reqN (void** out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            out[i] = req();
+        }
+    }
+
+    /** Release n objects. Pools which can do better than one rel() per object override this. */
+    virtual void relN (void* const* in, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            rel(in[i]);
+        }
+    }
 };
 
+template <class C, class P> class pool_ptr;
+
 /**
  * MemoryPool
  *
@@ -73,47 +472,223 @@ public:
  * Provides a more efficient method of constructing and destructing
  * objects, minimizing heap memory allocation/freeing and providing
  * more control over memory management.
+ *
+ * Objects are aligned to alignof(C), or to Align if that is larger, and
+ * neighbouring objects are Align bytes apart at least. Pass POOL_CACHE_LINE
+ * to keep objects off each others cache lines.
+ *
+ * Objects carry no header: an unused object's storage holds the link to the
+ * next unused object, so objects are sizeof(C) apart, rounded up to the
+ * alignment and to at least a pointer.
+ *
+ * Slabs are aligned to their own size, so the pool owning an object can be
+ * found from the object's address alone (see owner()).
+ *
+ * Watch is one of the watch policies above. The default calls back every
+ * PoolWatcher added to the pool; PoolWatchNone makes request() and release()
+ * as cheap as a bare free list, at the cost of object counts (see
+ * TRACK_LIVE), and PoolWatchOccupancy keeps the counts for trim() and
+ * decay() without reporting anything.
+ *
+ * Memory is only given back to the OS by trim(), shrinkToFit() and decay(),
+ * a whole slab at a time, once every object in the slab is unused.
+ *
+ * Slabs come from a PoolBacking, poolDefaultBacking() unless another is
+ * passed to the constructor.
  */
-template <class C> class MemoryPool : public Pool
+template <class C, std::size_t Align = 0, class Watch = PoolWatchCallbacks> class MemoryPool : public Pool, private Watch
 {
 private:
+    static_assert((Align & (Align - 1)) == 0, "MemoryPool alignment must be a power of two");
+
+    /** Link of the list of unused objects, stored in the unused object itself */
     struct Node {
         Node* next;
-        char data[sizeof(C)];
     }* unused;
 
-    struct Watcher {
-        Watcher*     next;
-        PoolWatcher* watcher;
-    }* watcher;
+    /** Header at the start of each slab, the nodes follow it */
+    struct Slab {
+        Slab*       next;
+        MemoryPool* owner;
+        std::size_t unusedCount; // Only valid during trim()
+    }* slabs;
+
+    PoolBacking* backing;
+    PoolGrowth   growth;
+    unsigned     lastGrowth;
+
+    // Statistics. Object counts are only kept if Watch::TRACK_LIVE.
+    std::size_t numSlabs;
+    std::size_t live;
+    std::size_t peak;
+    std::size_t windowPeak; // Peak since the last decay
+
+    // Decay
+    std::chrono::steady_clock::duration   decayTime;
+    std::chrono::steady_clock::time_point decayStart;
+
+    /** Alignment of objects (and of slabs) */
+    static std::size_t alignment ()
+    {
+        std::size_t a = alignof(C) > alignof(Node) ? alignof(C) : alignof(Node);
+        return Align > a ? Align : a;
+    }
+
+    /** Bytes between neighbouring objects, each big enough to hold a node while unused */
+    static std::size_t stride ()
+    {
+        return poolRoundUp(sizeof(C) > sizeof(Node) ? sizeof(C) : sizeof(Node), alignment());
+    }
+
+    /** Offset of the first node from the start of its slab */
+    static std::size_t slabHeader ()
+    {
+        return poolRoundUp(sizeof(Slab), alignment());
+    }
+
+    /** Bytes in one slab */
+    static std::size_t slabBytes ()
+    {
+        return poolSlabBytes(stride());
+    }
+
+    /** Objects carved out of one slab */
+    static std::size_t slabObjects ()
+    {
+        return (slabBytes() - slabHeader()) / stride();
+    }
+
+    /** Allocate num slabs and link their nodes into the list of unused objects */
+    void grow (unsigned num)
+    {
+        const std::size_t bytes = slabBytes();
+        const std::size_t count = slabObjects();
+        const std::size_t step  = stride();
+        while (num-- > 0)
+        {
+            Slab* slab = (Slab*)backing->allocate(bytes);
+            Watch::onAlloc(int(bytes));
+            slab->next = slabs;
+            slab->owner = this;
+            slabs = slab;
+            ++numSlabs;
+
+            // Link back to front, so that requests walk the slab in address order
+            char* nodes = (char*)slab + slabHeader();
+            for (std::size_t i = count; i-- > 0; )
+            {
+                Node* node = (Node*)(nodes + i * step);
+                node->next = unused;
+                unused = node;
+            }
+        }
+    }
+
+    static Slab* slabOf (const void* p)
+    {
+        return (Slab*)((std::uintptr_t)p & ~(std::uintptr_t)(slabBytes() - 1));
+    }
+
+    /** Count n more live objects */
+    void counted (std::size_t n)
+    {
+        if (!Watch::TRACK_LIVE)
+        {
+            return;
+        }
+        live += n;
+        if (live > windowPeak)
+        {
+            windowPeak = live;
+            if (live > peak)
+            {
+                peak = live;
+            }
+        }
+    }
+
+    /** Count n fewer live objects */
+    void uncounted (std::size_t n)
+    {
+        if (Watch::TRACK_LIVE)
+        {
+            live -= n;
+        }
+    }
+
+    /** Objects requested and not yet released, counted from the unused list if they are not tracked */
+    std::size_t liveObjects () const
+    {
+        if (Watch::TRACK_LIVE)
+        {
+            return live;
+        }
+        std::size_t spare = 0;
+        for (Node* n = unused; n; n = n->next)
+        {
+            ++spare;
+        }
+        return numSlabs * slabObjects() - spare;
+    }
+
+    /** Unlink the next unused object, allocating more slabs if there are none */
+    Node* take ()
+    {
+        if (unused == 0)
+        {
+            // Allocate more slabs
+            lastGrowth = growth.next(lastGrowth);
+            grow(lastGrowth);
+        }
+        Node* temp = unused;
+        unused = unused->next;
+        return temp;
+    }
+
+    void* defaultRequest (std::true_type)
+    {
+        return (void*)request();
+    }
+
+    void* defaultRequest (std::false_type)
+    {
+        return 0;
+    }
+
+    void defaultRequestN (void** out, std::size_t n, std::true_type)
+    {
+        requestN((C**)out, n);
+    }
+
+    void defaultRequestN (void** out, std::size_t n, std::false_type)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            out[i] = 0;
+        }
+    }
 
     /** Allocate num objects */
     void alloc (int num)
     {
         if (num > 0)
         {
-            Node* temp;
-            CALL_WATCHERS(onAlloc(sizeof(Node) * num));
-            while (num-- > 0)
-            {
-                temp = new Node;
-                temp->next = unused;
-                unused = temp;
-            }
+            const std::size_t count = slabObjects();
+            grow(unsigned((std::size_t(num) + count - 1) / count));
         }
     }
 
 public:
-    MemoryPool () : unused(0), watcher(0)
+    MemoryPool () : unused(0), slabs(0), backing(&poolDefaultBacking()), growth(PoolGrowth::capped(1, 64)), lastGrowth(0), numSlabs(0), live(0), peak(0), windowPeak(0), decayTime(0)
     {
     }
 
-    MemoryPool (int num) : unused(0), watcher(0)
+    MemoryPool (int num) : unused(0), slabs(0), backing(&poolDefaultBacking()), growth(PoolGrowth::capped(1, 64)), lastGrowth(0), numSlabs(0), live(0), peak(0), windowPeak(0), decayTime(0)
     {
         alloc(num);
     }
 
-    MemoryPool (PoolWatcher* w) : unused(0), watcher(0)
+    MemoryPool (PoolWatcher* w) : unused(0), slabs(0), backing(&poolDefaultBacking()), growth(PoolGrowth::capped(1, 64)), lastGrowth(0), numSlabs(0), live(0), peak(0), windowPeak(0), decayTime(0)
     {
         if (w)
         {
@@ -121,7 +696,7 @@ public:
         }
     }
 
-    MemoryPool (int num, PoolWatcher* w) : unused(0), watcher(0)
+    MemoryPool (int num, PoolWatcher* w) : unused(0), slabs(0), backing(&poolDefaultBacking()), growth(PoolGrowth::capped(1, 64)), lastGrowth(0), numSlabs(0), live(0), peak(0), windowPeak(0), decayTime(0)
     {
         if (w)
         {
@@ -130,38 +705,66 @@ public:
         alloc(num);
     }
 
+    MemoryPool (int num, PoolGrowth g, PoolWatcher* w=0) : unused(0), slabs(0), backing(&poolDefaultBacking()), growth(g), lastGrowth(0), numSlabs(0), live(0), peak(0), windowPeak(0), decayTime(0)
+    {
+        if (w)
+        {
+            addWatcher(w);
+        }
+        alloc(num);
+    }
+
+    MemoryPool (int num, PoolGrowth g, PoolBacking& b, PoolWatcher* w=0) : unused(0), slabs(0), backing(&b), growth(g), lastGrowth(0), numSlabs(0), live(0), peak(0), windowPeak(0), decayTime(0)
+    {
+        if (w)
+        {
+            addWatcher(w);
+        }
+        alloc(num);
+    }
+
+    /** Pools own their slabs, and objects point back to their pool, so they cannot be copied */
+    MemoryPool (const MemoryPool&) = delete;
+    MemoryPool& operator= (const MemoryPool&) = delete;
+
+    /**
+     * Free all slabs.
+     * Objects which were not released are not destructed, but their memory is freed.
+     */
     ~MemoryPool ()
     {
         int num = 0;
-        Node* temp;
-        // Free memory for each unused object
-        while (unused != 0)
+        Slab* temp;
+        // Free memory for each slab
+        while (slabs != 0)
         {
-            temp = unused;
-            unused = unused->next;
-            delete temp;
+            temp = slabs;
+            slabs = slabs->next;
+            backing->deallocate(temp, slabBytes());
             ++num;
         }
+        unused = 0;
         // Notify watchers
-        CALL_WATCHERS(onFree(sizeof(Node) * num));
-
-        // Remove watchers (memory for watcher is not freed here)
-        Watcher* w;
-        while (watcher)
-        {
-            w = watcher;
-            watcher = watcher->next;
-            delete w;
-        }
+        Watch::onFree(int(slabBytes() * num));
     }
 
     /** Add a watcher to be notified of memory management events */
     void addWatcher (PoolWatcher* w)
     {
-        Watcher* watch = new Watcher;
-        watch->watcher = w;
-        watch->next = watcher;
-        watcher = watch;
+        Watch::add(w);
+    }
+
+    /** The watch policy, to read its counters */
+    const Watch& watch () const
+    {
+        return *this;
+    }
+
+    /** Set how the pool grows when it runs out of unused objects */
+    void setGrowth (PoolGrowth g)
+    {
+        growth = g;
+        lastGrowth = 0;
     }
 
     unsigned objectSize () const
@@ -169,27 +772,103 @@ public:
         return sizeof(C);
     }
 
-    /** Request the construction of a new object */
-    C* request ()
+    /** Request the construction of a new object, passing args to its constructor */
+    template <class... Args> C* request (Args&&... args)
     {
-        Node* temp;
-        if (unused == 0)
+        Node* temp = take();
+
+        // Construct object
+        C* c;
+        try {
+            c = new(temp) C(std::forward<Args>(args)...);
+        } catch (...) {
+            // Put the node back if the constructor throws
+            temp->next = unused;
+            unused = temp;
+            throw;
+        }
+        counted(1);
+
+        // Notify watchers once the object exists
+        Watch::onRequest(c, sizeof(C));
+        return c;
+    }
+
+    /**
+     * Request the default construction of n objects into out.
+     * The run of n unused objects is unlinked in one pass, and watchers are notified once.
+     */
+    void requestN (C** out, std::size_t n)
+    {
+        if (n == 0)
         {
-            // Allocate a new object
-            temp = new Node;
-            CALL_WATCHERS(onAlloc(sizeof(Node)));
-        } else
+            return;
+        }
+
+        // Unlink n unused objects, allocating more slabs whenever the list runs dry
+        Node* temp = unused;
+        for (std::size_t i = 0; i < n; ++i)
         {
-            // Unlink the next unused object
-            temp = unused;
-            unused = unused->next;
+            if (temp == 0)
+            {
+                unused = 0;
+                lastGrowth = growth.next(lastGrowth);
+                try {
+                    grow(lastGrowth);
+                } catch (...) {
+                    // Put back the nodes already taken if no more slabs can be allocated
+                    for (std::size_t j = i; j-- > 0; )
+                    {
+                        Node* node = (Node*)out[j];
+                        node->next = unused;
+                        unused = node;
+                    }
+                    throw;
+                }
+                temp = unused;
+            }
+            out[i] = (C*)temp;
+            temp = temp->next;
         }
+        unused = temp;
 
-        // Notify watchers
-        CALL_WATCHERS(onRequest(temp->data));
+        // Construct the objects
+        std::size_t i = 0;
+        try {
+            for (; i < n; ++i)
+            {
+                new(out[i]) C;
+            }
+        } catch (...) {
+            // Destruct what was constructed and put all nodes back
+            for (std::size_t j = n; j-- > 0; )
+            {
+                if (j < i)
+                {
+                    out[j]->~C();
+                }
+                Node* node = (Node*)out[j];
+                node->next = unused;
+                unused = node;
+            }
+            throw;
+        }
+        counted(n);
 
-        // Cnstruct and return object
-        return new(temp->data) C;
+        // Notify watchers once the objects exist
+        Watch::onRequestN((void* const*)out, n, sizeof(C));
+    }
+
+    /** Request the construction of a new object, owned by the returned handle */
+    template <class... Args> pool_ptr<C, MemoryPool> make (Args&&... args)
+    {
+        return pool_ptr<C, MemoryPool>(request(std::forward<Args>(args)...));
+    }
+
+    /** The pool which an object was requested from */
+    static MemoryPool* owner (const C* c)
+    {
+        return slabOf(c)->owner;
     }
 
     /** Release and destruct an onject */
@@ -197,22 +876,288 @@ public:
     {
         // Destruct object
         c->~C();
-        // Retrieve the node
-        Node* temp = (Node*)(((char*)c) - sizeof(Node*));
+        // Reuse its storage as a node
+        Node* temp = (Node*)c;
         // Notify watchers
-        CALL_WATCHERS(onRelease(temp->data));
+        Watch::onRelease(temp, sizeof(C));
         // Link the object into the list of unused objects
         temp->next = unused;
         unused = temp;
+        uncounted(1);
+    }
+
+    /**
+     * Release and destruct n objects.
+     * The objects are linked together and spliced onto the unused list in one step, and watchers are notified once.
+     */
+    void releaseN (C* const* in, std::size_t n)
+    {
+        if (n == 0)
+        {
+            return;
+        }
+
+        // Destruct the objects and link them into a chain
+        Node* first = (Node*)in[0];
+        Node* last  = first;
+        in[0]->~C();
+        for (std::size_t i = 1; i < n; ++i)
+        {
+            in[i]->~C();
+            Node* node = (Node*)in[i];
+            last->next = node;
+            last = node;
+        }
+
+        // Notify watchers
+        Watch::onReleaseN((void* const*)in, n, sizeof(C));
+
+        // Splice the chain onto the list of unused objects
+        last->next = unused;
+        unused = first;
+        uncounted(n);
     }
 
+    /**
+     * Current object counts. Unless Watch::TRACK_LIVE, this walks the
+     * unused objects, and peak is 0.
+     */
+    PoolStats stats () const
+    {
+        PoolStats s;
+        s.live  = liveObjects();
+        s.peak  = Watch::TRACK_LIVE ? peak : 0;
+        s.free  = numSlabs * slabObjects() - s.live;
+        s.slabs = numSlabs;
+        s.bytes = numSlabs * slabBytes();
+        return s;
+    }
+
+    /**
+     * Give slabs whose objects are all unused back to the OS, for as long as
+     * more than keep unused objects would remain. Returns the number of
+     * slabs freed. Takes time proportional to the number of unused objects.
+     */
+    std::size_t trim (std::size_t keep)
+    {
+        const std::size_t count = slabObjects();
+        std::size_t spare = numSlabs * count - liveObjects();
+        if (spare < keep + count)
+        {
+            return 0;
+        }
+
+        // Count the unused objects in each slab
+        Slab* slab;
+        for (slab = slabs; slab; slab = slab->next)
+        {
+            slab->unusedCount = 0;
+        }
+        for (Node* n = unused; n; n = n->next)
+        {
+            ++slabOf(n)->unusedCount;
+        }
+
+        // Pick empty slabs to free, marking them by setting their count past the slab size
+        std::size_t freed = 0;
+        for (slab = slabs; slab && spare >= keep + count; slab = slab->next)
+        {
+            if (slab->unusedCount == count)
+            {
+                slab->unusedCount = count + 1;
+                spare -= count;
+                ++freed;
+            }
+        }
+        if (freed == 0)
+        {
+            return 0;
+        }
+
+        // Drop the objects of those slabs from the list of unused objects
+        Node** link = &unused;
+        while (*link)
+        {
+            if (slabOf(*link)->unusedCount > count)
+            {
+                *link = (*link)->next;
+            } else
+            {
+                link = &(*link)->next;
+            }
+        }
+
+        // And free them
+        Slab** s = &slabs;
+        while (*s)
+        {
+            slab = *s;
+            if (slab->unusedCount > count)
+            {
+                *s = slab->next;
+                backing->deallocate(slab, slabBytes());
+            } else
+            {
+                s = &slab->next;
+            }
+        }
+        numSlabs -= freed;
+        lastGrowth = 0;
+
+        // Notify watchers
+        Watch::onFree(int(slabBytes() * freed));
+        return freed;
+    }
+
+    /** Give every slab whose objects are all unused back to the OS */
+    std::size_t shrinkToFit ()
+    {
+        return trim(0);
+    }
+
+    /**
+     * Free memory which has sat unused for longer than time, as seen by
+     * decay(). A time of zero, the default, turns decay off. Needs a watch
+     * policy which tracks live objects.
+     */
+    void setDecay (std::chrono::steady_clock::duration time)
+    {
+        static_assert(Watch::TRACK_LIVE, "MemoryPool decay needs a watch policy with TRACK_LIVE, such as PoolWatchOccupancy");
+        decayTime  = time;
+        decayStart = std::chrono::steady_clock::now();
+        windowPeak = live;
+    }
+
+    /**
+     * If the decay time has passed since the last decay, trim the objects
+     * which were never needed during that time, and start a new period.
+     * Cheap when no decay is due, so it can be called from the owning thread's
+     * event loop or timer; the pool itself never calls it.
+     * Returns the number of slabs freed.
+     */
+    std::size_t decay ()
+    {
+        if (decayTime == std::chrono::steady_clock::duration::zero())
+        {
+            return 0;
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - decayStart < decayTime)
+        {
+            return 0;
+        }
+        // Unused objects beyond the peak of the last period were idle all along
+        std::size_t freed = trim(windowPeak - live);
+        decayStart = now;
+        windowPeak = live;
+        return freed;
+    }
+
+    /** Default construct an object, or return 0 if C has no default constructor */
     void* req ()
     {
-        return (void*)request();
+        return defaultRequest(typename std::is_default_constructible<C>::type());
     }
 
     void rel(void* o)
     {
         release((const C* const)o);
     }
-};
\ No newline at end of file
+
+    /** Default construct n objects, or return zeros if C has no default constructor */
+    void reqN (void** out, std::size_t n)
+    {
+        defaultRequestN(out, n, typename std::is_default_constructible<C>::type());
+    }
+
+    void relN (void* const* in, std::size_t n)
+    {
+        releaseN((C* const*)in, n);
+    }
+};
+
+/**
+ * pool_ptr
+ *
+ * Unique ownership of an object from a MemoryPool, which is released back to
+ * its pool when the handle is destroyed or reset. The pool is found from the
+ * object's address, so a handle is no bigger than a plain pointer.
+ */
+template <class C, class P = MemoryPool<C> > class pool_ptr
+{
+private:
+    C* ptr;
+
+public:
+    pool_ptr (const pool_ptr&) = delete;
+    pool_ptr& operator= (const pool_ptr&) = delete;
+
+    pool_ptr () : ptr(0)
+    {
+    }
+
+    explicit pool_ptr (C* c) : ptr(c)
+    {
+    }
+
+    pool_ptr (pool_ptr&& other) : ptr(other.ptr)
+    {
+        other.ptr = 0;
+    }
+
+    ~pool_ptr ()
+    {
+        reset();
+    }
+
+    pool_ptr& operator= (pool_ptr&& other)
+    {
+        if (this != &other)
+        {
+            reset(other.ptr);
+            other.ptr = 0;
+        }
+        return *this;
+    }
+
+    /** Release the current object to its pool and take ownership of c */
+    void reset (C* c=0)
+    {
+        C* old = ptr;
+        ptr = c;
+        if (old)
+        {
+            P::owner(old)->release(old);
+        }
+    }
+
+    /** Give up ownership without releasing the object */
+    C* release ()
+    {
+        C* c = ptr;
+        ptr = 0;
+        return c;
+    }
+
+    C* get () const
+    {
+        return ptr;
+    }
+
+    C& operator* () const
+    {
+        return *ptr;
+    }
+
+    C* operator-> () const
+    {
+        return ptr;
+    }
+
+    explicit operator bool () const
+    {
+        return ptr != 0;
+    }
+};
+
+#endif // MEMORYPOOL_H
@@ -0,0 +1,444 @@
+/**
+ * Benchmarks MemoryPool against new/delete, malloc/free and std::allocator.
+ *
+ * Build and run:
+ *      g++ -std=c++11 -O2 -pthread MemoryPoolBenchmark.cpp -o MemoryPoolBenchmark
+ *      ./MemoryPoolBenchmark [operations] [max threads]
+ *
+ * For each workload and object size, prints nanoseconds and millions of
+ * operations per second (one operation is a request or a release), how
+ * much the resident set size grew over the workload, and cache misses per
+ * operation when the kernel lets us read hardware counters. Each run gets
+ * a process of its own where fork is available, so that memory one
+ * allocator keeps after it is done is not counted against the next.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "MemoryPool.h"
+#include "ConcurrentMemoryPool.h"
+
+// Objects of N bytes, touched on construction so that every allocator pays for the same writes.
+template <std::size_t N> struct Object
+{
+    char bytes[N];
+    Object () { bytes[0] = 1; }
+};
+
+// Allocators under test. Each has get() and put(), and a name.
+
+template <class T> struct PoolBench
+{
+    MemoryPool<T, 0, PoolWatchNone> pool;
+    static const char* name () { return "MemoryPool"; }
+    T* get () { return pool.request(); }
+    void put (T* t) { pool.release(t); }
+};
+
+template <class T> struct ConcurrentPoolBench
+{
+    ConcurrentMemoryPool<T> pool;
+    static const char* name () { return "ConcurrentMemoryPool"; }
+    T* get () { return pool.request(); }
+    void put (T* t) { pool.release(t); }
+};
+
+template <class T> struct NewBench
+{
+    static const char* name () { return "new/delete"; }
+    T* get () { return new T; }
+    void put (T* t) { delete t; }
+};
+
+template <class T> struct MallocBench
+{
+    static const char* name () { return "malloc/free"; }
+    T* get () { return new(std::malloc(sizeof(T))) T; }
+    void put (T* t) { t->~T(); std::free(t); }
+};
+
+template <class T> struct StdBench
+{
+    std::allocator<T> alloc;
+    static const char* name () { return "std::allocator"; }
+    T* get () { T* t = alloc.allocate(1); return new(t) T; }
+    void put (T* t) { t->~T(); alloc.deallocate(t, 1); }
+};
+
+// Cache miss counter, for the calling thread and any threads it starts afterwards.
+class CacheMisses
+{
+private:
+    int fd;
+
+public:
+    CacheMisses () : fd(-1)
+    {
+#if defined(__linux__)
+        perf_event_attr attr = perf_event_attr();
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMisses ()
+    {
+#if defined(__linux__)
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+#endif
+    }
+
+    void start ()
+    {
+#if defined(__linux__)
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /** Misses since start(), or -1 if hardware counters are not available */
+    long long stop ()
+    {
+#if defined(__linux__)
+        if (fd >= 0)
+        {
+            long long count = 0;
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) == (ssize_t)sizeof(count))
+            {
+                return count;
+            }
+        }
+#endif
+        return -1;
+    }
+};
+
+// Resident set size in KB, or -1 if unknown.
+long residentKB ()
+{
+#if defined(__linux__)
+    long pages = -1, resident = -1;
+    FILE* f = std::fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+        {
+            resident = -1;
+        }
+        std::fclose(f);
+    }
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}
+
+// Growth of the resident set size in KB since baseline, or -1 if unknown.
+long residentSinceKB (long baseline)
+{
+    long now = residentKB();
+    return now < 0 || baseline < 0 ? -1 : now - baseline;
+}
+
+// Run one benchmark, in a child process where we can.
+template <class F> void isolated (F run)
+{
+#if defined(__linux__)
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        run();
+        std::fflush(stdout);
+        _exit(0);
+    }
+    if (pid > 0)
+    {
+        int status;
+        waitpid(pid, &status, 0);
+        return;
+    }
+#endif
+    run();
+}
+
+void report (const char* workload, std::size_t size, const char* allocator, std::size_t ops, double seconds, long rss, long long misses)
+{
+    std::printf("%-18s %5zu  %-22s %8.2f ns/op %8.2f Mops/s %9ld KB",
+                workload, size, allocator, ops > 0 ? seconds * 1e9 / ops : 0.0, seconds > 0 ? ops / seconds / 1e6 : 0.0, rss);
+    if (misses >= 0 && ops > 0)
+    {
+        std::printf(" %7.3f misses/op\n", double(misses) / ops);
+    } else
+    {
+        std::printf("       n/a misses/op\n");
+    }
+}
+
+// Small deterministic generator, so that every allocator sees the same order.
+struct Random
+{
+    unsigned long long state;
+    Random () : state(0x9E3779B97F4A7C15ull) {}
+    std::size_t next (std::size_t n)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return std::size_t(state % n);
+    }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double since (Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Steady state: keep 'live' objects, replacing a random one on every step.
+template <class A> void churn (std::size_t ops)
+{
+    typedef typename std::remove_reference<decltype(*A().get())>::type T;
+    const std::size_t live = 10000;
+    long baseline = residentKB();
+    A alloc;
+    std::vector<T*> objects(live);
+    for (std::size_t i = 0; i < live; ++i)
+    {
+        objects[i] = alloc.get();
+    }
+    Random rnd;
+    CacheMisses misses;
+    misses.start();
+    Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < ops / 2; ++i)
+    {
+        std::size_t k = rnd.next(live);
+        alloc.put(objects[k]);
+        objects[k] = alloc.get();
+    }
+    double seconds = since(start);
+    long long m = misses.stop();
+    report("churn", sizeof(T), A::name(), ops, seconds, residentSinceKB(baseline), m);
+    for (std::size_t i = 0; i < live; ++i)
+    {
+        alloc.put(objects[i]);
+    }
+}
+
+// Bursts: request many objects, then release them all, in LIFO or random order.
+template <class A> void burst (std::size_t ops, bool randomOrder)
+{
+    typedef typename std::remove_reference<decltype(*A().get())>::type T;
+    const std::size_t count = 100000;
+    const std::size_t rounds = std::max<std::size_t>(1, ops / (count * 2));
+    long baseline = residentKB();
+    A alloc;
+    std::vector<T*> objects(count);
+    std::vector<std::size_t> order(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        order[i] = count - 1 - i;
+    }
+    if (randomOrder)
+    {
+        Random rnd;
+        for (std::size_t i = count; i > 1; --i)
+        {
+            std::swap(order[i - 1], order[rnd.next(i)]);
+        }
+    }
+    CacheMisses misses;
+    misses.start();
+    Clock::time_point start = Clock::now();
+    long rss = 0;
+    for (std::size_t r = 0; r < rounds; ++r)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            objects[i] = alloc.get();
+        }
+        if (r == 0)
+        {
+            rss = residentSinceKB(baseline);
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            alloc.put(objects[order[i]]);
+        }
+    }
+    double seconds = since(start);
+    long long m = misses.stop();
+    report(randomOrder ? "burst/random" : "burst/lifo", sizeof(T), A::name(), rounds * count * 2, seconds, rss, m);
+}
+
+// Single producer, single consumer ring of object pointers.
+template <class T> struct Ring
+{
+    static const std::size_t SIZE = 1024;
+    std::atomic<std::size_t> head;
+    char pad1[64];
+    std::atomic<std::size_t> tail;
+    char pad2[64];
+    T* slots[SIZE];
+
+    Ring () : head(0), tail(0) {}
+
+    bool push (T* t)
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == SIZE)
+        {
+            return false;
+        }
+        slots[h % SIZE] = t;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    T* pop ()
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+        {
+            return 0;
+        }
+        T* item = slots[t % SIZE];
+        tail.store(t + 1, std::memory_order_release);
+        return item;
+    }
+};
+
+// Producer/consumer: pairs of threads, producers request and consumers release, through a shared allocator.
+template <class A> void producerConsumer (std::size_t ops, unsigned threads)
+{
+    typedef typename std::remove_reference<decltype(*A().get())>::type T;
+    const unsigned pairs = threads / 2 > 0 ? threads / 2 : 1;
+    const std::size_t perPair = ops / 2 / pairs;
+    long baseline = residentKB();
+    A alloc;
+    std::vector<std::unique_ptr<Ring<T> > > rings;
+    for (unsigned p = 0; p < pairs; ++p)
+    {
+        rings.push_back(std::unique_ptr<Ring<T> >(new Ring<T>));
+    }
+    CacheMisses misses;
+    misses.start();
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned p = 0; p < pairs; ++p)
+    {
+        Ring<T>* ring = rings[p].get();
+        workers.push_back(std::thread([&alloc, ring, perPair] {
+            for (std::size_t i = 0; i < perPair; ++i)
+            {
+                T* t = alloc.get();
+                while (!ring->push(t))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }));
+        workers.push_back(std::thread([&alloc, ring, perPair] {
+            for (std::size_t i = 0; i < perPair; )
+            {
+                T* t = ring->pop();
+                if (t)
+                {
+                    alloc.put(t);
+                    ++i;
+                } else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+    for (std::size_t i = 0; i < workers.size(); ++i)
+    {
+        workers[i].join();
+    }
+    double seconds = since(start);
+    long long m = misses.stop();
+    char label[32];
+    std::snprintf(label, sizeof(label), "prodcons/%uT", pairs * 2);
+    report(label, sizeof(T), A::name(), perPair * pairs * 2, seconds, residentSinceKB(baseline), m);
+}
+
+template <std::size_t N> void singleThreaded (std::size_t ops)
+{
+    typedef Object<N> T;
+    isolated([ops] { churn<PoolBench<T> >(ops); });
+    isolated([ops] { churn<NewBench<T> >(ops); });
+    isolated([ops] { churn<MallocBench<T> >(ops); });
+    isolated([ops] { churn<StdBench<T> >(ops); });
+    for (int randomOrder = 0; randomOrder < 2; ++randomOrder)
+    {
+        bool random = randomOrder != 0;
+        isolated([ops, random] { burst<PoolBench<T> >(ops, random); });
+        isolated([ops, random] { burst<NewBench<T> >(ops, random); });
+        isolated([ops, random] { burst<MallocBench<T> >(ops, random); });
+        isolated([ops, random] { burst<StdBench<T> >(ops, random); });
+    }
+}
+
+template <std::size_t N> void multiThreaded (std::size_t ops, unsigned maxThreads)
+{
+    typedef Object<N> T;
+    for (unsigned threads = 2; threads <= maxThreads; threads *= 2)
+    {
+        isolated([ops, threads] { producerConsumer<ConcurrentPoolBench<T> >(ops, threads); });
+        isolated([ops, threads] { producerConsumer<NewBench<T> >(ops, threads); });
+        isolated([ops, threads] { producerConsumer<MallocBench<T> >(ops, threads); });
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    std::size_t ops = argc > 1 ? std::strtoul(argv[1], 0, 10) : 10000000;
+    unsigned maxThreads = argc > 2 ? (unsigned)std::strtoul(argv[2], 0, 10) : std::thread::hardware_concurrency();
+    if (maxThreads < 2)
+    {
+        maxThreads = 2;
+    }
+
+    singleThreaded<16>(ops);
+    singleThreaded<64>(ops);
+    singleThreaded<256>(ops);
+    singleThreaded<1024>(ops);
+
+    multiThreaded<64>(ops, maxThreads);
+    multiThreaded<256>(ops, maxThreads);
+    return 0;
+}
@@ -0,0 +1,357 @@
+#ifndef PERSISTENTPOOL_H
+#define PERSISTENTPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MemoryPool.h"
+
+/***** Sample Usage:
+ * struct Node { int value; PersistentPool<Node>::Handle next; };
+ *
+ * PersistentPool<Node> nodes("nodes.pool");
+ * if (!nodes.root())
+ * {
+ *     // First run: build the graph
+ *     PersistentPool<Node>::Handle head = nodes.request();
+ *     nodes.get(head)->value = 1;
+ *     nodes.setRoot(head);
+ * }
+ * Node* head = nodes.get(nodes.root());   // Later runs: already there
+ *****/
+
+/**
+ * PersistentPool
+ *
+ * Pool whose objects live in a memory mapped file, so that a restarted
+ * process picks them up by mapping the file again. Opening an existing file
+ * reads its header and nothing else; objects are paged in as they are used.
+ *
+ * Objects refer to each other by Handle, an offset into the file, as the
+ * file lands at a different address in every process. Within a process the
+ * mapping never moves, so pointers from get() stay valid as the pool grows.
+ *
+ * The file holds a header (magic number, format version, object size and the
+ * root object), then the objects. As in MemoryPool, unused objects are linked
+ * through their own storage, so the list of unused objects is kept in the
+ * file too.
+ *
+ * C must be trivially copyable, as its bytes outlive the process. Changes
+ * reach the file whenever the kernel writes the pages back, or at flush();
+ * a crash between flushes may leave the file inconsistent. Not thread safe.
+ * POSIX only.
+ */
+template <class C> class PersistentPool
+{
+private:
+    static const std::uint64_t MAGIC   = 0x4C4F4F50594D454Dull; // "MEMYPOOL"
+    static const std::uint32_t VERSION = 1;
+
+    /** Address space set aside for the file by default: 64 GB, or 1 GB where addresses are 32 bits */
+    static const std::size_t DEFAULT_RESERVE = std::size_t(1) << (sizeof(std::size_t) >= 8 ? 36 : 30);
+
+    /** Start of the file */
+    struct Header {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t objectSize;
+        std::uint32_t alignment;
+        std::uint32_t stride;
+        std::uint64_t fileBytes; // Bytes of the file in use by the pool
+        std::uint64_t top;       // Offset of the first object never requested
+        std::uint64_t unused;    // Offset of the first unused object, or 0
+        std::uint64_t live;
+        std::uint64_t root;
+    };
+
+    /** Link of the list of unused objects, stored in the unused object itself */
+    struct Node {
+        std::uint64_t next;
+    };
+
+public:
+    /** Reference to an object, valid in any process which opens the file. The default handle is null. */
+    struct Handle {
+        std::uint64_t offset;
+
+        Handle () : offset(0) {}
+        explicit Handle (std::uint64_t o) : offset(o) {}
+
+        explicit operator bool () const
+        {
+            return offset != 0;
+        }
+
+        bool operator== (Handle h) const
+        {
+            return offset == h.offset;
+        }
+
+        bool operator!= (Handle h) const
+        {
+            return offset != h.offset;
+        }
+    };
+
+private:
+    int         fd;
+    char*       base;          // Start of the reserved address range, where the file is mapped
+    std::size_t reserveBytes;  // Size of the reserved range, the most the file can grow to
+    Header*     header;
+
+    static std::size_t alignment ()
+    {
+        return alignof(C) > alignof(Node) ? alignof(C) : alignof(Node);
+    }
+
+    static std::size_t stride ()
+    {
+        return poolRoundUp(sizeof(C) > sizeof(Node) ? sizeof(C) : sizeof(Node), alignment());
+    }
+
+    /** Offset of the first object */
+    static std::size_t dataOffset ()
+    {
+        return poolRoundUp(sizeof(Header), alignment() > POOL_CACHE_LINE ? alignment() : POOL_CACHE_LINE);
+    }
+
+    static std::size_t pageBytes ()
+    {
+        return (std::size_t)sysconf(_SC_PAGESIZE);
+    }
+
+    void fail (const std::string& what)
+    {
+        close();
+        throw std::runtime_error("PersistentPool: " + what);
+    }
+
+    void close ()
+    {
+        if (base)
+        {
+            munmap(base, reserveBytes);
+            base = 0;
+            header = 0;
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    /** Whether offset is where an object starts, below top */
+    bool isSlot (std::uint64_t offset) const
+    {
+        return offset >= dataOffset() && offset < header->top && (offset - dataOffset()) % stride() == 0;
+    }
+
+    /** Map bytes of the file from offset 'from' onwards into the reserved range */
+    bool map (std::size_t from, std::size_t bytes)
+    {
+        void* p = mmap(base + from, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, (off_t)from);
+        return p != MAP_FAILED;
+    }
+
+    /** Grow the file to hold at least one more object */
+    void grow ()
+    {
+        std::size_t old = (std::size_t)header->fileBytes;
+        std::size_t bytes = old * 2;
+        if (bytes > reserveBytes)
+        {
+            bytes = reserveBytes;
+        }
+        if (bytes < header->top + stride() || ftruncate(fd, (off_t)bytes) != 0 || !map(old, bytes - old))
+        {
+            throw std::bad_alloc();
+        }
+        header->fileBytes = bytes;
+    }
+
+public:
+    /**
+     * Open the pool in path, creating the file if it does not exist.
+     * reserveBytes of address space (rounded to pages) are set aside for the
+     * file to grow into. Throws std::runtime_error if the file cannot be
+     * opened, was written by a pool of another type or version, or has a
+     * header that does not fit the file.
+     */
+    PersistentPool (const char* path, std::size_t reserveBytes=DEFAULT_RESERVE) : fd(-1), base(0), reserveBytes(poolRoundUp(reserveBytes, pageBytes())), header(0)
+    {
+        // Checked here rather than in the class, so that C may hold handles into its own pool
+        static_assert(std::is_trivially_copyable<C>::value, "PersistentPool objects must be trivially copyable");
+        static_assert(alignof(C) <= 4096, "PersistentPool objects must not be aligned beyond a page");
+
+        fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            fail(std::string("cannot open ") + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            fail(std::string("cannot stat ") + path);
+        }
+
+        // Reserve the address range, then map the file over the start of it
+        void* p = mmap(0, this->reserveBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            fail("cannot reserve address space");
+        }
+        base = (char*)p;
+
+        if (st.st_size == 0)
+        {
+            // New file
+            std::size_t bytes = poolRoundUp(dataOffset() + 64 * stride(), pageBytes());
+            if (bytes < 1024 * 1024)
+            {
+                bytes = 1024 * 1024;
+            }
+            if (bytes > this->reserveBytes || ftruncate(fd, (off_t)bytes) != 0 || !map(0, bytes))
+            {
+                fail(std::string("cannot size ") + path);
+            }
+            header = (Header*)base;
+            header->version    = VERSION;
+            header->objectSize = sizeof(C);
+            header->alignment  = (std::uint32_t)alignment();
+            header->stride     = (std::uint32_t)stride();
+            header->fileBytes  = bytes;
+            header->top        = dataOffset();
+            header->unused     = 0;
+            header->live       = 0;
+            header->root       = 0;
+            // Written last, so that a file cut short during creation is not taken for a pool
+            header->magic      = MAGIC;
+            return;
+        }
+
+        // Existing file: check the header, and map it all
+        if ((std::size_t)st.st_size < sizeof(Header) || (std::size_t)st.st_size > this->reserveBytes || !map(0, (std::size_t)st.st_size))
+        {
+            fail(std::string("cannot map ") + path);
+        }
+        header = (Header*)base;
+        if (header->magic != MAGIC || header->version != VERSION)
+        {
+            fail(std::string(path) + " is not a pool file of this version");
+        }
+        if (header->objectSize != sizeof(C) || header->alignment != alignment() || header->stride != stride()
+            || header->fileBytes > (std::uint64_t)st.st_size)
+        {
+            fail(std::string(path) + " holds objects of another type");
+        }
+        // Only the header is read here, so only what it points at directly is checked
+        if (dataOffset() > header->fileBytes || header->top < dataOffset() || header->top > header->fileBytes
+            || (header->top - dataOffset()) % stride() != 0
+            || (header->unused != 0 && !isSlot(header->unused))
+            || (header->root != 0 && !isSlot(header->root))
+            || header->live > (header->top - dataOffset()) / stride())
+        {
+            fail(std::string(path) + " has a corrupt header");
+        }
+    }
+
+    PersistentPool (const PersistentPool&) = delete;
+    PersistentPool& operator= (const PersistentPool&) = delete;
+
+    /** Unmap the file. Objects which were not released stay in it. */
+    ~PersistentPool ()
+    {
+        close();
+    }
+
+    /** Request the construction of a new object, passing args to its constructor */
+    template <class... Args> Handle request (Args&&... args)
+    {
+        std::uint64_t offset = header->unused;
+        if (offset != 0)
+        {
+            header->unused = ((Node*)(base + offset))->next;
+        } else
+        {
+            if (header->top + stride() > header->fileBytes)
+            {
+                grow();
+            }
+            offset = header->top;
+            header->top += stride();
+        }
+        try {
+            new(base + offset) C(std::forward<Args>(args)...);
+        } catch (...) {
+            // Put the object back if the constructor throws
+            ((Node*)(base + offset))->next = header->unused;
+            header->unused = offset;
+            throw;
+        }
+        ++header->live;
+        return Handle(offset);
+    }
+
+    /** Release an object */
+    void release (Handle h)
+    {
+        Node* node = (Node*)(base + h.offset);
+        node->next = header->unused;
+        header->unused = h.offset;
+        --header->live;
+    }
+
+    /** The object of a handle, valid until the pool is closed */
+    C* get (Handle h) const
+    {
+        return (C*)(base + h.offset);
+    }
+
+    /** The handle of an object in the pool */
+    Handle handleOf (const C* c) const
+    {
+        return Handle((std::uint64_t)((const char*)c - base));
+    }
+
+    /** The object the application finds the others from, null until set */
+    Handle root () const
+    {
+        return Handle(header->root);
+    }
+
+    void setRoot (Handle h)
+    {
+        header->root = h.offset;
+    }
+
+    /** Objects requested and not yet released */
+    std::size_t size () const
+    {
+        return (std::size_t)header->live;
+    }
+
+    /** Bytes of the file */
+    std::size_t fileBytes () const
+    {
+        return (std::size_t)header->fileBytes;
+    }
+
+    /** Write all changes to the file and wait for them to reach the disk */
+    void flush ()
+    {
+        msync(base, (std::size_t)header->fileBytes, MS_SYNC);
+    }
+};
+
+#endif // PERSISTENTPOOL_H
@@ -0,0 +1,212 @@
+#ifndef POOLALLOCATOR_H
+#define POOLALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "SizeClassPool.h"
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define POOL_HAS_PMR 1
+#endif
+#endif
+
+/***** Sample Usage:
+ * // Nodes from the shared size class pools
+ * std::map<int, Foo, std::less<int>, PoolAllocator<std::pair<const int, Foo> > > fooMap;
+ *
+ * // Nodes from a heap of this thread's own
+ * SizeClassAllocator<> heap;
+ * std::list<Foo, PoolAllocator<Foo, LocalSizeClassPools> > fooList(PoolAllocator<Foo, LocalSizeClassPools>(heap));
+ *
+ * // C++17
+ * PoolMemoryResource<> resource;
+ * std::pmr::unordered_map<int, Foo> fooTable(&resource);
+ *****/
+
+/**
+ * PoolAllocator
+ *
+ * Standard allocator which takes single objects, the nodes of std::list,
+ * std::map, std::set and std::unordered_map, from the pools of a
+ * SizeClassAllocator. Rebinding keeps the same SizeClassAllocator, so a
+ * container's node type lands in the size class that fits it.
+ *
+ * Arrays (n > 1), such as the bucket array of std::unordered_map, and types
+ * aligned more strictly than std::max_align_t are not pooled.
+ *
+ * Default constructed allocators use sizeClassHeap(), so Family must then be
+ * SharedSizeClassPools. A LocalSizeClassPools heap must only be used by one
+ * thread at a time.
+ */
+template <class T, class Family = SharedSizeClassPools> class PoolAllocator
+{
+private:
+    template <class U, class F> friend class PoolAllocator;
+
+    SizeClassAllocator<Family>* heap;
+
+    static bool overAligned ()
+    {
+        return alignof(T) > alignof(std::max_align_t);
+    }
+
+public:
+    typedef T              value_type;
+    typedef T*             pointer;
+    typedef const T*       const_pointer;
+    typedef T&             reference;
+    typedef const T&       const_reference;
+    typedef std::size_t    size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <class U> struct rebind { typedef PoolAllocator<U, Family> other; };
+
+    PoolAllocator () : heap(&sizeClassHeap())
+    {
+    }
+
+    PoolAllocator (SizeClassAllocator<Family>& h) : heap(&h)
+    {
+    }
+
+    template <class U> PoolAllocator (const PoolAllocator<U, Family>& other) : heap(other.heap)
+    {
+    }
+
+    /** Most objects one call to allocate() can ask for */
+    size_type max_size () const
+    {
+        return std::size_t(-1) / sizeof(T);
+    }
+
+    /**
+     * Allocate room for n objects. Throws std::bad_array_new_length if n is
+     * over max_size(), and std::bad_alloc on failure.
+     */
+    T* allocate (std::size_t n)
+    {
+        if (n > max_size())
+        {
+            throw std::bad_array_new_length();
+        }
+        if (overAligned())
+        {
+            return (T*)poolAlignedAlloc(n * sizeof(T), alignof(T));
+        }
+        if (n != 1)
+        {
+            return (T*)::operator new(n * sizeof(T));
+        }
+        return (T*)heap->allocate(sizeof(T));
+    }
+
+    /** Free memory from allocate(), n must be what it was allocated with */
+    void deallocate (T* p, std::size_t n)
+    {
+        if (overAligned())
+        {
+            poolAlignedFree(p);
+        } else if (n != 1)
+        {
+            ::operator delete(p);
+        } else
+        {
+            heap->deallocate(p, sizeof(T));
+        }
+    }
+
+    template <class U, class... Args> void construct (U* p, Args&&... args)
+    {
+        new((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template <class U> void destroy (U* p)
+    {
+        p->~U();
+    }
+
+    /** The SizeClassAllocator behind this allocator */
+    SizeClassAllocator<Family>& sizeClasses () const
+    {
+        return *heap;
+    }
+
+    template <class U> bool operator== (const PoolAllocator<U, Family>& other) const
+    {
+        return heap == other.heap;
+    }
+
+    template <class U> bool operator!= (const PoolAllocator<U, Family>& other) const
+    {
+        return heap != other.heap;
+    }
+};
+
+#ifdef POOL_HAS_PMR
+
+/**
+ * PoolMemoryResource
+ *
+ * Polymorphic memory resource serving every size up to SIZE_CLASS_MAX from
+ * the pools of a SizeClassAllocator, for the std::pmr containers. Larger
+ * sizes go to malloc, and alignments stricter than std::max_align_t to
+ * poolAlignedAlloc().
+ *
+ * The default constructed resource uses sizeClassHeap(), so Family must then
+ * be SharedSizeClassPools.
+ */
+template <class Family = SharedSizeClassPools> class PoolMemoryResource : public std::pmr::memory_resource
+{
+private:
+    SizeClassAllocator<Family>* heap;
+
+protected:
+    void* do_allocate (std::size_t bytes, std::size_t align) override
+    {
+        if (align > alignof(std::max_align_t))
+        {
+            return poolAlignedAlloc(bytes, align);
+        }
+        return heap->allocate(bytes);
+    }
+
+    void do_deallocate (void* p, std::size_t bytes, std::size_t align) override
+    {
+        if (align > alignof(std::max_align_t))
+        {
+            poolAlignedFree(p);
+        } else
+        {
+            heap->deallocate(p, bytes);
+        }
+    }
+
+    bool do_is_equal (const std::pmr::memory_resource& other) const noexcept override
+    {
+        const PoolMemoryResource* r = dynamic_cast<const PoolMemoryResource*>(&other);
+        return r != 0 && r->heap == heap;
+    }
+
+public:
+    PoolMemoryResource () : heap(&sizeClassHeap())
+    {
+    }
+
+    PoolMemoryResource (SizeClassAllocator<Family>& h) : heap(&h)
+    {
+    }
+
+    /** The SizeClassAllocator behind this resource */
+    SizeClassAllocator<Family>& sizeClasses () const
+    {
+        return *heap;
+    }
+};
+
+#endif // POOL_HAS_PMR
+
+#endif // POOLALLOCATOR_H
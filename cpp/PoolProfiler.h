@@ -0,0 +1,349 @@
+#ifndef POOLPROFILER_H
+#define POOLPROFILER_H
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <execinfo.h>
+
+#include "MemoryPool.h"
+
+#if defined(__GNUC__)
+#define POOL_NOINLINE __attribute__((noinline))
+#else
+#define POOL_NOINLINE
+#endif
+
+/***** Sample Usage:
+ * PoolProfiler::global().setInterval(512 * 1024);
+ * MemoryPool<Foo, 0, PoolWatchSampled> fooPool;
+ * ...
+ * PoolProfiler::global().writeText(std::cerr);       // Live objects per allocation site
+ * std::ofstream out("pool.heap");
+ * PoolProfiler::global().writePprof(out);            // pprof --text ./binary pool.heap
+ *****/
+
+/**
+ * PoolProfiler
+ *
+ * Collects stack traces of a sample of pool requests, about one for every
+ * interval bytes requested, and follows each sampled object until it is
+ * released. Reports live objects and bytes per allocation site, as flat text
+ * or as a pprof heap profile.
+ *
+ * Samples are taken at random, exponentially distributed, byte distances
+ * so that every byte is equally likely to be sampled whatever the pattern
+ * of requests. Thread safe; only sampled requests and releases lock.
+ */
+class PoolProfiler
+{
+public:
+    static const unsigned MAX_FRAMES = 32;
+
+    /** What is known about the samples taken at one allocation site */
+    struct Site {
+        std::vector<void*> frames;
+        std::size_t        liveObjects;
+        std::size_t        liveBytes;
+        std::size_t        totalObjects;
+        std::size_t        totalBytes;
+        std::size_t        released;     // Released objects, whose lifetimes are known
+        double             lifetime;     // Total lifetime of released objects, in seconds
+        double             maxLifetime;
+    };
+
+private:
+    struct Sample {
+        Site*                                 site;
+        std::size_t                           bytes;
+        std::chrono::steady_clock::time_point requested;
+    };
+
+    struct FramesHash {
+        std::size_t operator() (const std::vector<void*>& frames) const
+        {
+            std::size_t h = 0;
+            for (std::size_t i = 0; i < frames.size(); ++i)
+            {
+                h = h * 31 + (std::size_t)frames[i];
+            }
+            return h;
+        }
+    };
+
+    std::mutex lock;
+    std::size_t interval;
+    std::unordered_map<std::vector<void*>, Site, FramesHash> sites;
+    std::unordered_map<void*, Sample> live;
+
+public:
+    PoolProfiler () : interval(512 * 1024)
+    {
+    }
+
+    /** Profiler used by PoolWatchSampled */
+    static PoolProfiler& global ()
+    {
+        static PoolProfiler profiler;
+        return profiler;
+    }
+
+    /** Mean number of bytes requested between samples */
+    void setInterval (std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        interval = bytes > 0 ? bytes : 1;
+    }
+
+    std::size_t getInterval ()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return interval;
+    }
+
+    /** Record a sampled request, skipping the innermost skip (at most 8) frames of its stack trace */
+    POOL_NOINLINE void sampleRequest (void* obj, std::size_t bytes, int skip)
+    {
+        void* frames[MAX_FRAMES + 8];
+        if (skip > 8)
+        {
+            skip = 8;
+        }
+        int depth = backtrace(frames, MAX_FRAMES + skip);
+        if (depth < skip)
+        {
+            skip = depth;
+        }
+        std::vector<void*> key(frames + skip, frames + depth);
+
+        std::lock_guard<std::mutex> guard(lock);
+        Site& site = sites[key];
+        if (site.frames.empty())
+        {
+            site.frames = key;
+            site.liveObjects = site.liveBytes = site.totalObjects = site.totalBytes = site.released = 0;
+            site.lifetime = site.maxLifetime = 0;
+        }
+        ++site.liveObjects;
+        site.liveBytes += bytes;
+        ++site.totalObjects;
+        site.totalBytes += bytes;
+
+        Sample sample = {&site, bytes, std::chrono::steady_clock::now()};
+        live[obj] = sample;
+    }
+
+    /** Record the release of an object which may have been sampled. Returns whether it was. */
+    bool sampleRelease (void* obj)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::unordered_map<void*, Sample>::iterator i = live.find(obj);
+        if (i == live.end())
+        {
+            return false;
+        }
+        Site* site = i->second.site;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - i->second.requested).count();
+        --site->liveObjects;
+        site->liveBytes -= i->second.bytes;
+        ++site->released;
+        site->lifetime += seconds;
+        if (seconds > site->maxLifetime)
+        {
+            site->maxLifetime = seconds;
+        }
+        live.erase(i);
+        return true;
+    }
+
+    /** Copy of the sites, most live bytes first */
+    std::vector<Site> snapshot ()
+    {
+        std::vector<Site> result;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (std::unordered_map<std::vector<void*>, Site, FramesHash>::iterator i = sites.begin(); i != sites.end(); ++i)
+            {
+                result.push_back(i->second);
+            }
+        }
+        std::multimap<std::size_t, std::size_t> order;
+        for (std::size_t i = 0; i < result.size(); ++i)
+        {
+            order.insert(std::make_pair(result[i].liveBytes, i));
+        }
+        std::vector<Site> sorted;
+        for (std::multimap<std::size_t, std::size_t>::reverse_iterator i = order.rbegin(); i != order.rend(); ++i)
+        {
+            sorted.push_back(result[i->second]);
+        }
+        return sorted;
+    }
+
+    /** Write live and total samples, and mean lifetime, per allocation site, with symbolized stacks */
+    void writeText (std::ostream& out)
+    {
+        std::vector<Site> s = snapshot();
+        std::size_t rate = getInterval();
+        out << "Pool profile, one sample per " << rate << " bytes\n";
+        for (std::size_t i = 0; i < s.size(); ++i)
+        {
+            out << "\n" << s[i].liveObjects << " live samples (" << s[i].liveBytes << " bytes), "
+                << s[i].totalObjects << " total (" << s[i].totalBytes << " bytes)";
+            if (s[i].released > 0)
+            {
+                out << ", mean lifetime " << s[i].lifetime / s[i].released << "s, max " << s[i].maxLifetime << "s";
+            }
+            out << "\n";
+            char** symbols = backtrace_symbols(&s[i].frames[0], (int)s[i].frames.size());
+            for (std::size_t f = 0; f < s[i].frames.size(); ++f)
+            {
+                out << "    " << (symbols ? symbols[f] : "?") << "\n";
+            }
+            std::free(symbols);
+        }
+    }
+
+    /** Write a pprof compatible (gperftools heap_v2) profile of the samples */
+    void writePprof (std::ostream& out)
+    {
+        std::vector<Site> s = snapshot();
+        std::size_t liveObjects = 0, liveBytes = 0, totalObjects = 0, totalBytes = 0;
+        for (std::size_t i = 0; i < s.size(); ++i)
+        {
+            liveObjects  += s[i].liveObjects;
+            liveBytes    += s[i].liveBytes;
+            totalObjects += s[i].totalObjects;
+            totalBytes   += s[i].totalBytes;
+        }
+        out << "heap profile: " << liveObjects << ": " << liveBytes << " [" << totalObjects << ": " << totalBytes
+            << "] @ heap_v2/" << getInterval() << "\n";
+        for (std::size_t i = 0; i < s.size(); ++i)
+        {
+            out << s[i].liveObjects << ": " << s[i].liveBytes << " [" << s[i].totalObjects << ": " << s[i].totalBytes << "] @";
+            for (std::size_t f = 0; f < s[i].frames.size(); ++f)
+            {
+                out << " " << s[i].frames[f];
+            }
+            out << "\n";
+        }
+
+        // pprof needs the mappings to symbolize the addresses
+        out << "\nMAPPED_LIBRARIES:\n";
+        std::ifstream maps("/proc/self/maps");
+        std::string line;
+        while (std::getline(maps, line))
+        {
+            out << line << "\n";
+        }
+    }
+};
+
+/**
+ * PoolWatchSampled
+ *
+ * Watch policy which feeds PoolProfiler::global(). Between samples a
+ * request costs a subtraction and a branch, and a release a test of one
+ * counter in a filter of the sampled addresses still live. Counters go up
+ * when an object is sampled and down when it is released, so the filter
+ * only ever holds the live samples and stays sparse however long the pool
+ * runs.
+ */
+class PoolWatchSampled
+{
+private:
+    std::ptrdiff_t      countdown;  // Bytes until the next sample
+    std::uint64_t       random;
+    std::uint8_t        filter[4096]; // Live samples per address hash. Sticks once full rather than wrapping.
+
+    static unsigned hash (void* obj)
+    {
+        return unsigned((((std::uintptr_t)obj >> 4) * 0x9E3779B97F4A7C15ull) >> 52);
+    }
+
+    /** Bytes until the next sample, exponentially distributed around the interval */
+    std::ptrdiff_t next ()
+    {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        double u = double((random >> 11) + 1) / double(std::uint64_t(1) << 53);
+        return std::ptrdiff_t(-std::log(u) * double(PoolProfiler::global().getInterval())) + 1;
+    }
+
+    POOL_NOINLINE void sample (void* obj, std::size_t bytes)
+    {
+        unsigned h = hash(obj);
+        if (filter[h] != 255)
+        {
+            ++filter[h];
+        }
+        // Skip sampleRequest and sample
+        PoolProfiler::global().sampleRequest(obj, bytes, 2);
+        countdown = next();
+    }
+
+public:
+    static const bool TRACK_LIVE = true;
+
+    PoolWatchSampled () : random((std::uint64_t)(std::uintptr_t)this | 1)
+    {
+        for (unsigned i = 0; i < 4096; ++i)
+        {
+            filter[i] = 0;
+        }
+        countdown = next();
+    }
+
+    void add       (PoolWatcher*) {}
+    void onAlloc   (int) {}
+    void onFree    (int) {}
+
+    void onRequest (void* obj, std::size_t bytes)
+    {
+        countdown -= std::ptrdiff_t(bytes);
+        if (countdown <= 0)
+        {
+            sample(obj, bytes);
+        }
+    }
+
+    void onRelease (void* obj, std::size_t)
+    {
+        unsigned h = hash(obj);
+        if (filter[h] != 0 && PoolProfiler::global().sampleRelease(obj) && filter[h] != 255)
+        {
+            // Only a sampled object takes its count back out; other objects
+            // which share the hash leave it alone.
+            --filter[h];
+        }
+    }
+
+    void onRequestN (void* const* objs, std::size_t n, std::size_t bytes)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            onRequest(objs[i], bytes);
+        }
+    }
+
+    void onReleaseN (void* const* objs, std::size_t n, std::size_t bytes)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            onRelease(objs[i], bytes);
+        }
+    }
+};
+
+#endif // POOLPROFILER_H
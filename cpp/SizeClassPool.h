@@ -0,0 +1,292 @@
+#ifndef SIZECLASSPOOL_H
+#define SIZECLASSPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "MemoryPool.h"
+#include "ConcurrentMemoryPool.h"
+
+/***** Sample Usage:
+ * SizeClassAllocator<> heap;
+ * char* buffer = (char*)heap.allocate(100);   // Served by the 112 byte pool
+ * ...
+ * heap.deallocate(buffer, 100);
+ *
+ * // In exactly one source file, to route all of new/delete through the
+ * // size class pools:
+ * #define SIZECLASS_OVERRIDE_NEW
+ * #include "SizeClassPool.h"
+ *****/
+
+/**
+ * Size classes
+ *
+ * Four classes per doubling above 128 bytes, so at most 25% of a block is
+ * wasted on rounding. Requests above SIZE_CLASS_MAX bytes are not pooled.
+ * There is no 8 byte class: blocks are aligned for any type, which pads
+ * them to at least alignof(std::max_align_t), 16 bytes on common targets.
+ */
+constexpr std::size_t SIZE_CLASSES[] = {
+             16,   32,   48,   64,   80,   96,  112,  128,
+     160,  192,  224,  256,  320,  384,  448,  512,
+     640,  768,  896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096
+};
+constexpr unsigned    NUM_SIZE_CLASSES = sizeof(SIZE_CLASSES) / sizeof(SIZE_CLASSES[0]);
+constexpr std::size_t SIZE_CLASS_MAX   = SIZE_CLASSES[NUM_SIZE_CLASSES - 1];
+
+/** Raw storage for one block of a size class */
+template <std::size_t N> struct PoolBlock
+{
+    alignas(alignof(std::max_align_t)) char data[N];
+};
+
+/**
+ * Size class pool families
+ *
+ * Pick the pool used for each size class, and the counters used for its
+ * statistics:
+ *      LocalSizeClassPools:  MemoryPool, for use by a single thread
+ *      SharedSizeClassPools: ConcurrentMemoryPool, for use by any thread
+ */
+struct LocalSizeClassPools
+{
+    template <class C> struct pool { typedef MemoryPool<C, 0, PoolWatchNone> type; };
+    typedef unsigned long counter;
+};
+
+struct SharedSizeClassPools
+{
+    template <class C> struct pool { typedef ConcurrentMemoryPool<C> type; };
+    typedef std::atomic<unsigned long> counter;
+};
+
+/** Statistics of one size class */
+template <class Family> struct SizeClassStats
+{
+    typename Family::counter requests; // Blocks requested
+    typename Family::counter releases; // Blocks released
+    typename Family::counter bytes;    // Bytes asked for, to measure the space lost to rounding
+
+    SizeClassStats () : requests(0), releases(0), bytes(0) {}
+
+    /** Blocks requested and not yet released */
+    unsigned long live () const
+    {
+        return (unsigned long)requests - (unsigned long)releases;
+    }
+};
+
+/** One pool per size class, from class I up, held by value so that building them needs no heap */
+template <class Family, unsigned I, bool End = (I == NUM_SIZE_CLASSES)> struct SizeClassChain
+{
+    typename Family::template pool<PoolBlock<SIZE_CLASSES[I]> >::type pool;
+    SizeClassChain<Family, I + 1> rest;
+
+    void fill (Pool** table)
+    {
+        table[I] = &pool;
+        rest.fill(table);
+    }
+};
+
+template <class Family, unsigned I> struct SizeClassChain<Family, I, true>
+{
+    void fill (Pool**) {}
+};
+
+/**
+ * SizeClassAllocator
+ *
+ * Variable size allocator which routes each request to the fixed size pool
+ * of the smallest size class which fits it, found with a single table
+ * lookup. Requests larger than SIZE_CLASS_MAX go to malloc.
+ *
+ * Like std::allocator, the size must be passed back to deallocate().
+ */
+template <class Family = LocalSizeClassPools> class SizeClassAllocator
+{
+private:
+    SizeClassChain<Family, 0> chain;
+    Pool*                     pools[NUM_SIZE_CLASSES];
+    unsigned char             lookup[SIZE_CLASS_MAX / 8 + 1]; // Size class of each multiple of 8 bytes
+    SizeClassStats<Family>    classStats[NUM_SIZE_CLASSES];
+    SizeClassStats<Family>    largeStats;
+
+public:
+    SizeClassAllocator ()
+    {
+        chain.fill(pools);
+        unsigned cls = 0;
+        for (std::size_t i = 0; i <= SIZE_CLASS_MAX / 8; ++i)
+        {
+            while (SIZE_CLASSES[cls] < i * 8)
+            {
+                ++cls;
+            }
+            lookup[i] = (unsigned char)cls;
+        }
+    }
+
+    SizeClassAllocator (const SizeClassAllocator&) = delete;
+    SizeClassAllocator& operator= (const SizeClassAllocator&) = delete;
+
+    /** Size class serving a request of bytes, or NUM_SIZE_CLASSES if it is not pooled */
+    unsigned sizeClass (std::size_t bytes) const
+    {
+        return bytes <= SIZE_CLASS_MAX ? lookup[(bytes + 7) >> 3] : NUM_SIZE_CLASSES;
+    }
+
+    /** Allocate bytes, aligned for any type. Throws std::bad_alloc on failure. */
+    void* allocate (std::size_t bytes)
+    {
+        unsigned cls = sizeClass(bytes);
+        SizeClassStats<Family>& s = cls < NUM_SIZE_CLASSES ? classStats[cls] : largeStats;
+        s.requests += 1;
+        s.bytes += bytes;
+        if (cls < NUM_SIZE_CLASSES)
+        {
+            return pools[cls]->req();
+        }
+        void* p = std::malloc(bytes);
+        if (p == 0)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    /** Free memory from allocate(), bytes must be the size it was allocated with */
+    void deallocate (void* p, std::size_t bytes)
+    {
+        unsigned cls = sizeClass(bytes);
+        if (cls < NUM_SIZE_CLASSES)
+        {
+            classStats[cls].releases += 1;
+            pools[cls]->rel(p);
+        } else
+        {
+            largeStats.releases += 1;
+            std::free(p);
+        }
+    }
+
+    /** Statistics of a size class, or of unpooled requests for NUM_SIZE_CLASSES */
+    const SizeClassStats<Family>& stats (unsigned cls) const
+    {
+        return cls < NUM_SIZE_CLASSES ? classStats[cls] : largeStats;
+    }
+
+    /** Pool of a size class */
+    Pool& pool (unsigned cls)
+    {
+        return *pools[cls];
+    }
+};
+
+/**
+ * The allocator behind the global new/delete override. It is built on first
+ * use and never destroyed, so that it outlives every static object which
+ * might delete something during exit.
+ */
+inline SizeClassAllocator<SharedSizeClassPools>& sizeClassHeap ()
+{
+    static typename std::aligned_storage<sizeof(SizeClassAllocator<SharedSizeClassPools>), alignof(SizeClassAllocator<SharedSizeClassPools>)>::type storage;
+    static SizeClassAllocator<SharedSizeClassPools>* heap = new(&storage) SizeClassAllocator<SharedSizeClassPools>;
+    return *heap;
+}
+
+/**
+ * Global new/delete through sizeClassHeap(). Each block carries a small
+ * header recording its size, as unsized delete must find the size class.
+ * Define SIZECLASS_OVERRIDE_NEW in exactly one source file.
+ */
+#ifdef SIZECLASS_OVERRIDE_NEW
+
+const std::size_t SIZE_CLASS_HEADER = alignof(std::max_align_t);
+
+void* operator new (std::size_t bytes)
+{
+    if (bytes > std::size_t(-1) - SIZE_CLASS_HEADER)
+    {
+        throw std::bad_alloc();
+    }
+    std::size_t total = bytes + SIZE_CLASS_HEADER;
+    for (;;)
+    {
+        try {
+            char* p = (char*)sizeClassHeap().allocate(total);
+            *(std::size_t*)p = total;
+            return p + SIZE_CLASS_HEADER;
+        } catch (const std::bad_alloc&) {
+            // As the standard requires, give the new handler a chance to
+            // free memory, and only fail once there is none
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+            {
+                throw;
+            }
+            handler();
+        }
+    }
+}
+
+void* operator new[] (std::size_t bytes)
+{
+    return operator new(bytes);
+}
+
+void* operator new (std::size_t bytes, const std::nothrow_t&) noexcept
+{
+    try {
+        return operator new(bytes);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void* operator new[] (std::size_t bytes, const std::nothrow_t&) noexcept
+{
+    return operator new(bytes, std::nothrow);
+}
+
+void operator delete (void* p) noexcept
+{
+    if (p)
+    {
+        char* block = (char*)p - SIZE_CLASS_HEADER;
+        sizeClassHeap().deallocate(block, *(std::size_t*)block);
+    }
+}
+
+void operator delete[] (void* p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete (void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[] (void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete (void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[] (void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+#endif // SIZECLASS_OVERRIDE_NEW
+
+#endif // SIZECLASSPOOL_H
@@ -0,0 +1,110 @@
+/**
+  * A flow field (or "Dijkstra map"): how many steps each cell near a target is from it, walking around
+  * whatever can't be walked on. Anything standing on the field finds its way to the target by stepping to
+  * any neighbouring cell that is one step closer, which takes no searching at all. So however many enemies
+  * are chasing the player, the field is worked out once (each time the player moves), not once per enemy.
+  *
+  * The field only reaches 'range' steps from the target, and only covers the cells in a box around it, so
+  * working it out costs the same however big the map is. Cells it doesn't reach are FLOW_UNREACHED.
+  *
+  * Each cell remembers which build of the field set it, rather than the whole box being cleared before each
+  * build. So a build only touches the cells it reaches.
+  */
+
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include <algorithm>    // We use std::max and std::min.
+#include <vector>
+
+#include "world.h"      // We use this to tell which cells can be walked on.
+
+// Steps from a cell the field doesn't reach.
+const int FLOW_UNREACHED = -1;
+
+// The steps the field walks in: right, left, down and up.
+const int FLOW_STEP_X[4] = {1, -1, 0, 0};
+const int FLOW_STEP_Y[4] = {0, 0, 1, -1};
+
+struct FlowField
+{
+    int x, y;                           // The top left cell of the box the field covers,
+    int size;                           // and how many cells wide and high it is.
+    std::vector<int> steps;             // Steps to the target from each cell of the box, row by row.
+    std::vector<unsigned int> built;    // Which build set each cell. Cells not set by the last build aren't reached.
+    unsigned int build;                 // How many times the field has been built.
+    std::vector<int> queue;             // Cells still to be walked from.
+};
+
+// Start with a field that reaches nowhere.
+inline void clearFlowField (FlowField& field)
+{
+    field.x = field.y = 0;
+    field.size = 0;
+    field.steps.clear();
+    field.built.clear();
+    field.build = 0;
+}
+
+// How many steps (x, y) is from the target, or FLOW_UNREACHED.
+inline int flowSteps (const FlowField& field, int x, int y)
+{
+    x -= field.x;
+    y -= field.y;
+    if (x < 0 || y < 0 || x >= field.size || y >= field.size) return FLOW_UNREACHED;
+    int cell = y * field.size + x;
+    return field.built[cell] == field.build ? field.steps[cell] : FLOW_UNREACHED;
+}
+
+// Work out the field for a target at (targetX, targetY), up to 'range' steps away. Only the cells from (fromX,
+// fromY) up to (not including) (toX, toY) are walked on, so only they need to be in memory.
+inline void buildFlowField (FlowField& field, Map& map, int targetX, int targetY, int range, int fromX, int fromY, int toX, int toY)
+{
+    field.size = 2 * range + 1;
+    field.x = targetX - range;
+    field.y = targetY - range;
+    if ((int)field.steps.size() != field.size * field.size)
+    {
+        field.steps.assign(field.size * field.size, 0);
+        field.built.assign(field.size * field.size, 0);
+        field.build = 0;
+    }
+    // A new build number makes every cell unreached, without touching any of them.
+    if (++field.build == 0)
+    {
+        // We have used every number there is. Start again.
+        field.built.assign(field.built.size(), 0);
+        field.build = 1;
+    }
+
+    // The box, cut down to the cells we may walk on.
+    int left = std::max(field.x, fromX), top = std::max(field.y, fromY);
+    int right = std::min(field.x + field.size, toX), bottom = std::min(field.y + field.size, toY);
+    if (targetX < left || targetX >= right || targetY < top || targetY >= bottom) return;
+
+    // Walk outwards from the target, one step at a time (a breadth first search).
+    int target = (targetY - field.y) * field.size + (targetX - field.x);
+    field.steps[target] = 0;
+    field.built[target] = field.build;
+    field.queue.clear();
+    field.queue.push_back(target);
+    for (unsigned next = 0; next < field.queue.size(); ++next)
+    {
+        int cell = field.queue[next];
+        int steps = field.steps[cell] + 1;
+        if (steps > range) break;   // The cells are walked in order of steps, so the rest are as far.
+        int cx = field.x + cell % field.size, cy = field.y + cell / field.size;
+        for (int direction = 0; direction < 4; ++direction)
+        {
+            int x = cx + FLOW_STEP_X[direction], y = cy + FLOW_STEP_Y[direction];
+            if (x < left || x >= right || y < top || y >= bottom) continue;
+            int neighbour = (y - field.y) * field.size + (x - field.x);
+            if (field.built[neighbour] == field.build || !isWalkable(map, x, y)) continue;
+            field.steps[neighbour] = steps;
+            field.built[neighbour] = field.build;
+            field.queue.push_back(neighbour);
+        }
+    }
+}
+
+#endif // FLOWFIELD_H
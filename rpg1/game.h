@@ -0,0 +1,589 @@
+/**
+  * The game itself: the player, the enemies, the items and the fighting, with no graphics at all.
+  *
+  * The game moves forward in fixed steps of TICK_MS milliseconds of game time (stepGame), however fast or
+  * slow the computer is. The real game calls stepGame as often as real time says it should, and draws what it
+  * finds in the Game afterwards; a server can call it as fast as it likes, for as many games as it likes.
+  *
+  * Nothing in here reads the clock, the keyboard or std::rand. Time is counted in ticks, the keys are handed
+  * in each tick, and the random numbers come from the game's own generator. So the same seed and the same keys
+  * always play out the same game, on any computer.
+  *
+  * Nothing is checked every tick just in case. Each active enemy has a timer (see timers.h) set for the next
+  * time it could possibly do anything, and only the enemies whose timers fire get to think; the player's input
+  * lockout is a timer too. So a tick costs about the same however many enemies there are, and nextEvent can
+  * tell the real game how long it may sleep for.
+  *
+  * Enemies near enough to the player come after it, following a flow field (see flowfield.h) that is worked out
+  * again each time the player moves. The rest wander about at random.
+  *
+  * Enemies take their turn in two halves. First the ones due this tick decide what to do, looking at the map
+  * as it was at the start of the tick; none of them moves yet, so they can all think at once, on as many threads
+  * as the game is given (the map is split into bands, one task per band). Then the moves are carried out one
+  * enemy at a time, lowest index first: if two enemies picked the same cell, the first one gets it. Either way
+  * the game plays out exactly the same however many threads it runs on.
+  */
+
+#ifndef GAME_H
+#define GAME_H
+
+#include <algorithm>    // We use this to sort the enemies' moves.
+#include <vector>
+
+#include "world.h"      // The map, characters and items, and loading them.
+#include "grid.h"       // We use this to find the enemies and items near a spot quickly.
+#include "workers.h"    // We use this to let the enemies think on several threads.
+#include "timers.h"     // We use this to wake the enemies up only when they have something to do.
+#include "flowfield.h"  // We use this to have the enemies chase the player.
+
+// How much game time one step of the game is, in milliseconds. All of the delays below are multiples of it.
+const unsigned int TICK_MS = 10;
+
+// The player can move (or attack) this often, in milliseconds.
+const unsigned int INPUT_DELAY = 250;
+
+// Enemies beside the player attack this often...
+const unsigned int ENEMY_ATTACK_DELAY = 750;
+// ...and the others move (chase the player, or wander) this often.
+const unsigned int ENEMY_MOVE_DELAY = 1000;
+
+// Enemies this many steps from the player (or fewer) chase it.
+const int ENEMY_CHASE_RANGE = 16;
+
+// How much of the map the player can see, in tiles. Only the enemies in view (or near it, see
+// Game::activeRange) do anything.
+const int VIEW_SIZE = 12;
+
+// How much health the player starts with.
+const int PLAYER_MAX_HEALTH = 10;
+
+// The owner of the timer that ends the input lockout. Enemies' timers are owned by the enemy's index.
+const int INPUT_TIMER = -1;
+
+// Returned by nextEvent when nothing will ever happen unless a key is pressed.
+const unsigned int NO_EVENT = 0xffffffffu;
+
+// Used to track the scrolling of the map (Try editing map.txt to create a huge map to see this in action).
+struct Position
+{
+    int x, y;
+};
+
+// What an enemy decided to do this tick. ENEMY_MOVE + n is a step of (ENEMY_STEP_X[n], ENEMY_STEP_Y[n]).
+enum { ENEMY_IDLE, ENEMY_ATTACK, ENEMY_MOVE };
+const int ENEMY_STEP_X[4] = {1, -1, 0, 0};
+const int ENEMY_STEP_Y[4] = {0, 0, 1, -1};
+
+struct EnemyMove
+{
+    int enemy;      // Index of the enemy.
+    int action;     // What it wants to do.
+
+    // Lowest enemy first.
+    bool operator< (const EnemyMove& other) const
+    {
+        return enemy < other.enemy;
+    }
+};
+
+// The keys held down during a step.
+struct Input
+{
+    bool up, down, left, right;
+    bool attack;    // The space bar. Also opens chests.
+};
+
+// Everything there is to know about one game.
+// Like the Map in it, a Game must stay where it is once started, so don't copy it or keep it in a std::vector.
+struct Game
+{
+    Map map;
+    Character player;
+    int gold;                       // Keep track of the players gold.
+    std::vector<Item> items;        // Items (well... treasure chests).
+    std::vector<Character> enemies; // Enemies.
+    Grid itemGrid, enemyGrid;       // The items and enemies, indexed by where they are.
+    std::vector<int> nearby;        // Used to hold what we find in the grids.
+
+    Position view;                  // Keep track of the scrolling of the background.
+    unsigned int time;              // Game time, in milliseconds. Goes up by TICK_MS each step.
+    unsigned int seed;              // Decides everything random that happens.
+
+    // Enemies up to this many cells outside the view act too (newGame sets 0). Set it to the size of the
+    // map to have every enemy on the map act, all the time. Their part of the map must fit in memory, so
+    // the chunk budget grows to fit.
+    int activeRange;
+    Position activeFrom, activeTo;  // The enemies from activeFrom up to (not including) activeTo act this tick.
+    TimerWheel timers;              // When each active enemy next thinks, in ticks, and when input is next allowed.
+    std::vector<int> enemyTimers;   // The id of each enemy's timer, or -1 if it has none.
+    std::vector<int> fired;         // The owners of the timers that fired this tick.
+    std::vector<std::vector<int> > bandDue;         // The enemies in each band that think this tick.
+    FlowField chase;                // The way to the player, from everywhere in the active area near it.
+    // The threads the enemies think on (newGame sets NULL, to think on this thread only). Games run on
+    // the same thread may share them.
+    Workers* workers;
+    std::vector<std::vector<EnemyMove> > bandMoves; // What the enemies in each band decided this tick.
+    std::vector<EnemyMove> moves;                   // And all of them together.
+
+    bool gotInput;                  // Flag used to block all further input until timer has reset.
+    bool attack;                    // Flag used to force the player to tap the space bar to attack.
+    bool over;                      // The player has died.
+};
+
+// The game's own random number generator. Returns a number from 0 to 32767 for whatever is at (x, y) this tick.
+// The same seed, tick and place always give the same number, so it doesn't matter in which order (or on which
+// thread) they are asked for.
+inline int gameRandom (const Game& game, int x, int y)
+{
+    // Mix it all up into one number (this is the "finaliser" of a well known hash function).
+    unsigned int h = game.seed ^ (game.time * 0x9E3779B1u) ^ ((unsigned int)x * 0x85EBCA77u) ^ ((unsigned int)y * 0xC2B2AE3Du);
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h & 0x7fff;
+}
+
+// Start a new game on the map in 'filename'. The seed decides everything random that will happen.
+// 'budget' and 'background' are passed on to loadMap. Returns false if the map couldn't be loaded.
+inline bool newGame (Game& game, const char* filename, unsigned int seed, size_t budget = CHUNK_BUDGET, bool background = true)
+{
+    // The player.
+    game.player.health = PLAYER_MAX_HEALTH;
+    game.player.x = game.player.y = 0;
+    game.player.image = 0;
+    game.player.parameter = 0;
+    game.gold = 0;
+
+    game.items.clear();
+    game.enemies.clear();
+    if (!loadMap(game.map, game.player.x, game.player.y, game.items, game.enemies, filename, budget, background))
+    {
+        return false;
+    }
+    buildGrid(game.itemGrid, game.map.width, game.map.height, game.items);
+    buildGrid(game.enemyGrid, game.map.width, game.map.height, game.enemies);
+
+    game.view.x = game.view.y = 0;
+    game.time = 0;
+    game.seed = seed;
+    game.activeRange = 0;
+    // Nothing is active yet: the first step wakes up everything in view.
+    game.activeFrom.x = game.activeFrom.y = game.activeTo.x = game.activeTo.y = 0;
+    startTimers(game.timers, 0);
+    game.enemyTimers.assign(game.enemies.size(), -1);
+    clearFlowField(game.chase);
+    game.workers = NULL;
+    game.gotInput = false;
+    game.attack = false;
+    game.over = false;
+    return true;
+}
+
+// Free everything newGame allocated.
+inline void endGame (Game& game)
+{
+    unloadMap(game.map);
+    game.items.clear();
+    game.enemies.clear();
+    game.enemyTimers.clear();
+}
+
+// Make sure enemy i thinks as soon as it could do anything: when it's next ready to attack (it can't do
+// anything sooner), or this tick if it already is. If its timer is set for later, it's brought forward.
+// Waking an enemy too early does no harm: it just finds it has nothing to do yet.
+inline void wakeEnemy (Game& game, int i)
+{
+    unsigned int when = std::max(game.enemies[i].parameter + ENEMY_ATTACK_DELAY, game.time);
+    unsigned int due = when / TICK_MS;
+    int& timer = game.enemyTimers[i];
+    if (timer != -1)
+    {
+        if (game.timers.timers[timer].due <= due) return;
+        cancelTimer(game.timers, timer);
+    }
+    timer = addTimer(game.timers, due, i);
+}
+
+// Wake up every enemy from (x, y) up to (not including) (toX, toY).
+inline void wakeArea (Game& game, int x, int y, int toX, int toY)
+{
+    if (x >= toX || y >= toY) return;
+    findInGrid(game.enemyGrid, game.enemies, x, y, toX - x, toY - y, game.nearby);
+    for (unsigned i = 0; i < game.nearby.size(); ++i)
+    {
+        wakeEnemy(game, game.nearby[i]);
+    }
+}
+
+// Remove enemy i from the game. The last enemy takes its place (and its index).
+inline void removeEnemy (Game& game, int i)
+{
+    if (game.enemyTimers[i] != -1) cancelTimer(game.timers, game.enemyTimers[i]);
+    int last = game.enemies.size() - 1;
+    game.enemyTimers[i] = game.enemyTimers[last];
+    if (game.enemyTimers[i] != -1) game.timers.timers[game.enemyTimers[i]].owner = i;
+    game.enemyTimers.pop_back();
+    removeFromGrid(game.enemyGrid, game.enemies, i);
+}
+
+// Decide what enemy i does this tick, and reset its action timer if it does anything.
+// This only reads the map and the player, and only writes to the enemy itself, so all of the enemies can
+// think at once.
+inline int thinkEnemy (Game& game, int i)
+{
+    Map& map = game.map;
+    Character& goblin = game.enemies[i];
+
+    // If the enemy is in range of the player...
+    if (goblin.x >= game.player.x-1 && goblin.x <= game.player.x+1 &&
+        goblin.y >= game.player.y-1 && goblin.y <= game.player.y+1)
+    {
+        // Enemy in range. Potentially attack.
+        if (game.time - goblin.parameter < ENEMY_ATTACK_DELAY) return ENEMY_IDLE;
+        // ATTACK!
+        goblin.parameter = game.time;
+        return ENEMY_ATTACK;
+    }
+
+    // Enemy is not in range. Is it ready for an action?
+    if (game.time - goblin.parameter < ENEMY_MOVE_DELAY) return ENEMY_IDLE;
+    // Reset its action timer.
+    goblin.parameter = game.time;
+
+    // If the player is close by, take a step towards it: any step that gets one closer will do. We start
+    // looking in a random direction, so that enemies don't all favour the same way round things.
+    int steps = flowSteps(game.chase, goblin.x, goblin.y);
+    if (steps != FLOW_UNREACHED)
+    {
+        int first = gameRandom(game, goblin.x, goblin.y) % 4;
+        for (int n = 0; n < 4; ++n)
+        {
+            int direction = (first + n) % 4;
+            int x = goblin.x + ENEMY_STEP_X[direction], y = goblin.y + ENEMY_STEP_Y[direction];
+            // Cells the field reaches can be walked on, but another enemy may be in the way.
+            if (flowSteps(game.chase, x, y) == steps - 1 && !isBlocked(map, x, y)) return ENEMY_MOVE + direction;
+        }
+        // Every way closer is blocked. Wait for the others to move on.
+        return ENEMY_IDLE;
+    }
+
+    // Otherwise move in a random direction (or stay put, one time in five).
+    int direction = gameRandom(game, goblin.x, goblin.y) % 5;
+    if (direction == 4) return ENEMY_IDLE;
+    int x = goblin.x + ENEMY_STEP_X[direction], y = goblin.y + ENEMY_STEP_Y[direction];
+    // If the new position is walkable and not blocked, the enemy wants to move there.
+    if (isBlocked(map, x, y) || !isWalkable(map, x, y)) return ENEMY_IDLE;
+    return ENEMY_MOVE + direction;
+}
+
+// A task: let the enemies due this tick in one band of the map (a row of grid buckets) think.
+inline void thinkBand (void* data, int band)
+{
+    Game& game = *(Game*)data;
+    std::vector<EnemyMove>& moves = game.bandMoves[band];
+    const std::vector<int>& due = game.bandDue[band];
+    moves.clear();
+
+    for (unsigned i = 0; i < due.size(); ++i)
+    {
+        EnemyMove move = {due[i], thinkEnemy(game, due[i])};
+        if (move.action != ENEMY_IDLE) moves.push_back(move);
+    }
+}
+
+// Fire this tick's timers, and let the enemies they wake up act. Returns how much damage they did to the player.
+inline int updateEnemies (Game& game)
+{
+    Map& map = game.map;
+    int top = game.activeFrom.y, bottom = game.activeTo.y;
+    int bands = bottom > top ? ((bottom - 1) >> GRID_SHIFT) - (top >> GRID_SHIFT) + 1 : 0;
+    if ((int)game.bandDue.size() < bands)
+    {
+        game.bandDue.resize(bands);
+        game.bandMoves.resize(bands);
+    }
+    for (int band = 0; band < bands; ++band)
+    {
+        game.bandDue[band].clear();
+    }
+
+    // Sort out who is due.
+    game.fired.clear();
+    advanceTimers(game.timers, game.fired);
+    int dueCount = 0;
+    for (unsigned i = 0; i < game.fired.size(); ++i)
+    {
+        int owner = game.fired[i];
+        if (owner == INPUT_TIMER)
+        {
+            // The player may move (or attack) again from the next tick on.
+            game.gotInput = false;
+            continue;
+        }
+        game.enemyTimers[owner] = -1;
+        // An enemy that has wandered (or been scrolled) out of the active area goes to sleep. It's woken up
+        // again when the area takes it back in.
+        const Character& goblin = game.enemies[owner];
+        if (goblin.x < game.activeFrom.x || goblin.x >= game.activeTo.x || goblin.y < top || goblin.y >= bottom) continue;
+        game.bandDue[(goblin.y >> GRID_SHIFT) - (top >> GRID_SHIFT)].push_back(owner);
+        dueCount++;
+    }
+    if (dueCount == 0) return 0;
+
+    // First every enemy due decides what to do, against the map as it was at the start of the tick.
+    runTasks(game.workers, bands, thinkBand, &game);
+
+    // Then we carry out what they decided, lowest enemy first.
+    game.moves.clear();
+    for (int band = 0; band < bands; ++band)
+    {
+        game.moves.insert(game.moves.end(), game.bandMoves[band].begin(), game.bandMoves[band].end());
+    }
+    std::sort(game.moves.begin(), game.moves.end());
+
+    int damage = 0;
+    for (unsigned i = 0; i < game.moves.size(); ++i)
+    {
+        if (game.moves[i].action == ENEMY_ATTACK)
+        {
+            damage++;
+            continue;
+        }
+        Character& goblin = game.enemies[game.moves[i].enemy];
+        int direction = game.moves[i].action - ENEMY_MOVE;
+        int x = goblin.x + ENEMY_STEP_X[direction], y = goblin.y + ENEMY_STEP_Y[direction];
+        // If an enemy before this one took the cell, this one stays put.
+        if (isBlocked(map, x, y)) continue;
+
+        // Move the block along with the enemy, and let the grid know where it is now.
+        setBlocked(map, goblin.x, goblin.y, false);
+        setBlocked(map, x, y, true);
+        gridMove(game.enemyGrid, game.moves[i].enemy, goblin.x, goblin.y, x, y);
+        goblin.x = x;
+        goblin.y = y;
+    }
+
+    // Set each of them a timer for the next time it could act: ENEMY_ATTACK_DELAY after it last acted if
+    // it can't attack yet, or else ENEMY_MOVE_DELAY after (it was too far away to attack this time). If the
+    // player comes close before then, stepGame wakes it up sooner.
+    for (int band = 0; band < bands; ++band)
+    {
+        const std::vector<int>& due = game.bandDue[band];
+        for (unsigned i = 0; i < due.size(); ++i)
+        {
+            unsigned int last = game.enemies[due[i]].parameter;
+            unsigned int next = last + (game.time - last < ENEMY_ATTACK_DELAY ? ENEMY_ATTACK_DELAY : ENEMY_MOVE_DELAY);
+            game.enemyTimers[due[i]] = addTimer(game.timers, next / TICK_MS, due[i]);
+        }
+    }
+    return damage;
+}
+
+// The game time of the next step that might do anything, with these keys held down, or NO_EVENT if nothing
+// will happen until a key is pressed. Steps before then change nothing but the time, so the real game can
+// sleep until this (or a key) comes along. It may be too early, but it is never too late.
+inline unsigned int nextEvent (Game& game, const Input& input)
+{
+    if (game.over) return NO_EVENT;
+    // Held keys act on the next step, unless input is locked out (the lockout has a timer of its own).
+    bool keys = input.up || input.down || input.left || input.right || input.attack;
+    if (keys && !game.gotInput) return game.time + TICK_MS;
+    // Letting go of the space bar has to be noticed, so the next tap attacks.
+    if (game.attack && !input.attack) return game.time + TICK_MS;
+    // Holding it down on a chest picks it up.
+    if (input.attack)
+    {
+        findInGrid(game.itemGrid, game.items, game.player.x, game.player.y, 1, 1, game.nearby);
+        if (!game.nearby.empty()) return game.time + TICK_MS;
+    }
+    unsigned int tick = nextTimer(game.timers);
+    return tick == TIMER_NEVER ? NO_EVENT : tick * TICK_MS;
+}
+
+// Move the game on by one tick (TICK_MS of game time), with these keys held down.
+inline void stepGame (Game& game, const Input& input)
+{
+    // Nothing happens once the player is dead.
+    if (game.over) return;
+
+    Map& map = game.map;
+    Character& player = game.player;
+    game.time += TICK_MS;
+    Position moved = {player.x, player.y};
+
+    bool willHaveInput = false;  // Used to tell the input timer set logic to run.
+    // If we have not already recieved input and the up key is pushed down...
+    if (!game.gotInput && input.up)
+    {
+        // The player wants to move up.
+        if (isWalkable(map, player.x, player.y-1)
+            && !isBlocked(map, player.x, player.y-1)) player.y -= 1;
+        willHaveInput = true;
+    }
+    if (!game.gotInput && input.down)
+    {
+        // The player wants to move down.
+        if (isWalkable(map, player.x, player.y+1)
+            && !isBlocked(map, player.x, player.y+1)) player.y += 1;
+        willHaveInput = true;
+    }
+    if (!game.gotInput && input.right)
+    {
+        // The player wants to move right.
+        if (isWalkable(map, player.x+1, player.y)
+            && !isBlocked(map, player.x+1, player.y)) player.x += 1;
+        willHaveInput = true;
+    }
+    if (!game.gotInput && input.left)
+    {
+        // The player wants to move left.
+        if (isWalkable(map, player.x-1, player.y)
+            && !isBlocked(map, player.x-1, player.y)) player.x -= 1;
+        willHaveInput = true;
+    }
+    if (input.attack)
+    {
+        if (!game.gotInput && !game.attack)
+        {
+            game.attack = true;
+
+            // The player wants to attack.
+            willHaveInput = true;
+
+            // Check is there anything adjacent to tyhe players position.
+            if (isBlocked(map, player.x, player.y-1) ||
+                isBlocked(map, player.x, player.y+1) ||
+                isBlocked(map, player.x-1, player.y) ||
+                isBlocked(map, player.x+1, player.y) ||
+                isBlocked(map, player.x+1, player.y-1) ||
+                isBlocked(map, player.x+1, player.y+1) ||
+                isBlocked(map, player.x-1, player.y-1) ||
+                isBlocked(map, player.x-1, player.y+1))
+            {
+                // Yes, there is.
+                // Find the enemies in range of the player.
+                findInGrid(game.enemyGrid, game.enemies, player.x-1, player.y-1, 3, 3, game.nearby);
+                // We can only attack one enemy at a time, so we take the first.
+                if (!game.nearby.empty())
+                {
+                    Character& enemy = game.enemies[game.nearby[0]];
+                    // Now we know which enemy to attack.
+                    // Decrease it's health.
+                    enemy.health -= 1;
+                    // If it's health is zero...
+                    if (enemy.health <= 0)
+                    {
+                        // The enemy has died, remove it from the list.
+                        // Unblock the current location.
+                        setBlocked(map, enemy.x, enemy.y, false);
+                        // And delete the enemy from the enemy list (and the grid, and its timer).
+                        removeEnemy(game, game.nearby[0]);
+                    }
+                }
+            }
+        }
+
+        // Check treasure chests, in case the player wanted to get ggold from a chest.
+        // Find the items on the same tile as the player.
+        findInGrid(game.itemGrid, game.items, player.x, player.y, 1, 1, game.nearby);
+        // there can only be one item on a tile, so we only need the first.
+        if (!game.nearby.empty())
+        {
+            // We found a chest.
+            // Get the gold.
+            game.gold += game.items[game.nearby[0]].type;
+            // Remove the item from the list (and the grid).
+            removeFromGrid(game.itemGrid, game.items, game.nearby[0]);
+        }
+    } else {
+        // The player is not pressing the spacebar.
+        game.attack = false;
+    }
+
+    // We have recieved input, update the timer and scroll the tilemap, if needs be.
+    if (willHaveInput)
+    {
+        game.gotInput = true;
+        // We are ready to accept input again once INPUT_DELAY has passed: from the step after this timer fires.
+        addTimer(game.timers, (game.time + INPUT_DELAY) / TICK_MS, INPUT_TIMER);
+
+        // The player has moved (most likely..), we may need to scroll the map.
+        // If the player is near the edge of the screen and the map is not yet fully scrolled, scroll it.
+        // C position first. To the left.
+        if (player.x - game.view.x < 3 && game.view.x > 0)
+        {
+            game.view.x--;
+            // And to the right.
+        } else if (player.x - game.view.x > 8 && game.view.x < map.width-VIEW_SIZE)
+        {
+            game.view.x++;
+        }
+        // Then Y position. Left.
+        if (player.y - game.view.y < 3 && game.view.y > 0)
+        {
+            game.view.y--;
+            // And right.
+        } else if (player.y - game.view.y > 8 && game.view.y < map.height-VIEW_SIZE)
+        {
+            game.view.y++;
+        }
+    }
+
+    // The enemies in view, and within activeRange of it, get to act.
+    Position oldFrom = game.activeFrom, oldTo = game.activeTo;
+    game.activeFrom.x = std::max(game.view.x - game.activeRange, 0);
+    game.activeFrom.y = std::max(game.view.y - game.activeRange, 0);
+    game.activeTo.x   = std::min(game.view.x + VIEW_SIZE + game.activeRange, map.width);
+    game.activeTo.y   = std::min(game.view.y + VIEW_SIZE + game.activeRange, map.height);
+    int left = game.activeFrom.x, top = game.activeFrom.y, right = game.activeTo.x, bottom = game.activeTo.y;
+    if (left != oldFrom.x || top != oldFrom.y || right != oldTo.x || bottom != oldTo.y)
+    {
+        // Wake up the enemies the area has just taken in.
+        if (oldFrom.x >= oldTo.x || oldFrom.y >= oldTo.y || oldTo.x <= left || oldFrom.x >= right
+            || oldTo.y <= top || oldFrom.y >= bottom)
+        {
+            // None of it was active before.
+            wakeArea(game, left, top, right, bottom);
+        } else {
+            // The rows above and below the old area, then the columns either side of it.
+            wakeArea(game, left, top, right, oldFrom.y);
+            wakeArea(game, left, oldTo.y, right, bottom);
+            int fromY = std::max(top, oldFrom.y), toY = std::min(bottom, oldTo.y);
+            wakeArea(game, left, fromY, oldFrom.x, toY);
+            wakeArea(game, oldTo.x, fromY, right, toY);
+        }
+    }
+    // Enemies the player has just walked up to may be able to attack sooner than their timers say.
+    if (player.x != moved.x || player.y != moved.y)
+    {
+        wakeArea(game, std::max(player.x-1, left), std::max(player.y-1, top), std::min(player.x+2, right), std::min(player.y+2, bottom));
+    }
+
+    // Make sure the part of the map they can see (one cell further) is in memory, and start loading the parts
+    // around it. Enemies can't read chunks in while they think, so all of it has to fit.
+    int fromX = game.activeFrom.x - 1, fromY = game.activeFrom.y - 1, toX = game.activeTo.x + 1, toY = game.activeTo.y + 1;
+    int needed = (mapChunks(std::min(toX, map.width)) - std::max(fromX, 0) / MAP_CHUNK_SIZE)
+               * (mapChunks(std::min(toY, map.height)) - std::max(fromY, 0) / MAP_CHUNK_SIZE);
+    if (map.maxChunks < needed) map.maxChunks = needed;
+    updateChunks(map, fromX, fromY, toX - fromX, toY - fromY);
+
+    // The way to the player only changes when the player moves (or the active area does, as the field
+    // only covers that).
+    if (player.x != moved.x || player.y != moved.y
+        || left != oldFrom.x || top != oldFrom.y || right != oldTo.x || bottom != oldTo.y)
+    {
+        buildFlowField(game.chase, map, player.x, player.y, ENEMY_CHASE_RANGE, left, top, right, bottom);
+    }
+
+    // Let the enemies have their turn.
+    player.health -= updateEnemies(game);
+    // Player death.
+    if (player.health <= 0)
+    {
+        game.over = true;
+    }
+}
+
+#endif // GAME_H
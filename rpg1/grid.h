@@ -0,0 +1,128 @@
+/**
+  * A spatial index for the things on the map (enemies and items), so that we can find the ones near a spot
+  * without looking at every single one of them.
+  *
+  * The map is cut into square buckets of GRID_SIZE x GRID_SIZE cells, and each bucket keeps a list of the
+  * things standing in it, by their index in the game's vector of enemies (or items). To find what's on screen
+  * we only look in the few buckets the screen covers, so it takes the same time however many enemies the
+  * map holds.
+  *
+  * The grid must be told whenever one of its things moves (gridMove). Remove things with removeFromGrid: it
+  * takes them out of the grid and out of their vector, by moving the last thing in the vector into the gap
+  * (swap-and-pop) rather than shifting everything after it down. That's quick, but it means a thing's index
+  * can change whenever another thing is removed.
+  */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <algorithm>    // We use this to sort what we find.
+#include <vector>
+
+// Buckets are this many cells a side. The screen covers at most 2x2 of them.
+const int GRID_SHIFT = 4;
+const int GRID_SIZE  = 1 << GRID_SHIFT;
+
+struct Grid
+{
+    int width, height;                      // Size of the map, in cells.
+    int bucketsWide, bucketsHigh;           // Size of the grid, in buckets.
+    std::vector<std::vector<int> > buckets; // The things in each bucket, row by row.
+    std::vector<int> slots;                 // Where each thing is in its bucket's list.
+};
+
+// The bucket holding cell (x, y), which must be on the map.
+inline std::vector<int>& gridBucket (Grid& grid, int x, int y)
+{
+    return grid.buckets[(y >> GRID_SHIFT) * grid.bucketsWide + (x >> GRID_SHIFT)];
+}
+
+// Put thing 'index', standing at (x, y), into the grid.
+inline void gridAdd (Grid& grid, int index, int x, int y)
+{
+    std::vector<int>& bucket = gridBucket(grid, x, y);
+    if (index >= (int)grid.slots.size()) grid.slots.resize(index + 1);
+    grid.slots[index] = bucket.size();
+    bucket.push_back(index);
+}
+
+// Take thing 'index', standing at (x, y), out of the grid. The last thing in its bucket takes its slot.
+inline void gridRemove (Grid& grid, int index, int x, int y)
+{
+    std::vector<int>& bucket = gridBucket(grid, x, y);
+    int slot = grid.slots[index];
+    bucket[slot] = bucket.back();
+    grid.slots[bucket[slot]] = slot;
+    bucket.pop_back();
+}
+
+// Thing 'index' has moved from (oldX, oldY) to (x, y).
+inline void gridMove (Grid& grid, int index, int oldX, int oldY, int x, int y)
+{
+    // Most moves stay within a bucket, and there's nothing to do.
+    if ((oldX >> GRID_SHIFT) == (x >> GRID_SHIFT) && (oldY >> GRID_SHIFT) == (y >> GRID_SHIFT)) return;
+    gridRemove(grid, index, oldX, oldY);
+    gridAdd(grid, index, x, y);
+}
+
+// Set up a grid over a map of width x height cells, holding all of 'things' (anything with an x and a y).
+template <class T> void buildGrid (Grid& grid, int width, int height, const std::vector<T>& things)
+{
+    grid.width       = width;
+    grid.height      = height;
+    grid.bucketsWide = (width + GRID_SIZE - 1) >> GRID_SHIFT;
+    grid.bucketsHigh = (height + GRID_SIZE - 1) >> GRID_SHIFT;
+    grid.buckets.assign(grid.bucketsWide * grid.bucketsHigh, std::vector<int>());
+    grid.slots.assign(things.size(), 0);
+    for (unsigned i = 0; i < things.size(); ++i)
+    {
+        gridAdd(grid, i, things[i].x, things[i].y);
+    }
+}
+
+// Remove things[index] from the grid and from 'things'. The last thing takes its index.
+template <class T> void removeFromGrid (Grid& grid, std::vector<T>& things, int index)
+{
+    gridRemove(grid, index, things[index].x, things[index].y);
+    int last = things.size() - 1;
+    if (index != last)
+    {
+        // Move the last thing into the gap, and tell its bucket about its new index.
+        things[index] = things[last];
+        grid.slots[index] = grid.slots[last];
+        gridBucket(grid, things[index].x, things[index].y)[grid.slots[index]] = index;
+    }
+    things.pop_back();
+    grid.slots.pop_back();
+}
+
+// Find the things standing in the w x h cells from (x, y), and put their indices in 'found', lowest first.
+template <class T> void findInGrid (Grid& grid, const std::vector<T>& things, int x, int y, int w, int h, std::vector<int>& found)
+{
+    found.clear();
+    // Only look at the part of the rectangle that is on the map.
+    int left = x < 0 ? 0 : x, top = y < 0 ? 0 : y;
+    int right = x + w > grid.width ? grid.width : x + w, bottom = y + h > grid.height ? grid.height : y + h;
+    if (left >= right || top >= bottom) return;
+
+    for (int by = top >> GRID_SHIFT; by <= (bottom - 1) >> GRID_SHIFT; ++by)
+    {
+        for (int bx = left >> GRID_SHIFT; bx <= (right - 1) >> GRID_SHIFT; ++bx)
+        {
+            // The buckets on the edge of the rectangle hold things outside of it too.
+            const std::vector<int>& bucket = grid.buckets[by * grid.bucketsWide + bx];
+            for (unsigned i = 0; i < bucket.size(); ++i)
+            {
+                const T& thing = things[bucket[i]];
+                if (thing.x >= left && thing.x < right && thing.y >= top && thing.y < bottom)
+                {
+                    found.push_back(bucket[i]);
+                }
+            }
+        }
+    }
+    // Lowest index first, so we see them in the same order as looping through the whole vector would.
+    std::sort(found.begin(), found.end());
+}
+
+#endif // GRID_H
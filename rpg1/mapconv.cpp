@@ -0,0 +1,70 @@
+/**
+  * Converts a map from the text format (map.txt) to the binary format the game loads fastest.
+  * See mapfile.h for the layout of the binary format.
+  *
+  * Build:  g++ mapconv.cpp -o mapconv
+  * Usage:  mapconv map.txt map.bin
+  */
+
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "mapfile.h"
+
+// Write 'bytes' bytes at 'offset' in the file, padding with zeros up to there.
+bool writeAt (std::FILE* file, long long& position, MapOffset offset, const void* data, size_t bytes)
+{
+    while (position < offset)
+    {
+        if (std::fputc(0, file) == EOF) return false;
+        ++position;
+    }
+    if (bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes) return false;
+    position += bytes;
+    return true;
+}
+
+int main (int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " map.txt map.bin\n";
+        return 1;
+    }
+
+    // Read the text map.
+    MapFileHeader header;
+    std::vector<MapFileTile> tiles;
+    std::vector<MapInt> cells;
+    std::vector<MapFileChest> chests;
+    std::vector<MapFileEnemy> enemies;
+    if (!readTextMap(argv[1], header, tiles, cells, chests, enemies))
+    {
+        std::cerr << "Failed to read " << argv[1] << "\n";
+        return 1;
+    }
+
+    // And write out each section at the offset the header gives it.
+    std::FILE* file = std::fopen(argv[2], "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to create " << argv[2] << "\n";
+        return 1;
+    }
+    long long position = 0;
+    bool ok = writeAt(file, position, 0, &header, sizeof(header))
+           && writeAt(file, position, header.tilesOffset, tiles.empty() ? 0 : &tiles[0], tiles.size() * sizeof(MapFileTile))
+           && writeAt(file, position, header.mapOffset, cells.empty() ? 0 : &cells[0], cells.size() * sizeof(MapInt))
+           && writeAt(file, position, header.chestsOffset, chests.empty() ? 0 : &chests[0], chests.size() * sizeof(MapFileChest))
+           && writeAt(file, position, header.enemiesOffset, enemies.empty() ? 0 : &enemies[0], enemies.size() * sizeof(MapFileEnemy));
+    if (std::fclose(file) != 0 || !ok)
+    {
+        std::cerr << "Failed to write " << argv[2] << "\n";
+        return 1;
+    }
+
+    std::cout << argv[2] << ": " << header.width << "x" << header.height << " tiles, "
+              << header.numChests << " chests, " << header.numEnemies << " enemies\n";
+    return 0;
+}
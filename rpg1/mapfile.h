@@ -0,0 +1,272 @@
+/**
+  * The binary map format, and a reader for the old text format (map.txt).
+  *
+  * A binary map is laid out so that the game can read any part of the map straight out of the file,
+  * instead of parsing anything:
+  *
+  *     MapFileHeader                       Always at the start of the file.
+  *     MapFileTile    [numTiles]           The tile table.
+  *     int32          [chunks * 64 * 64]   Index into the tile table of every map cell, chunk by chunk.
+  *     MapFileChest   [numChests]          Treasure chests.
+  *     MapFileEnemy   [numEnemies]         Enemies.
+  *
+  * The map is cut into chunks of MAP_CHUNK_SIZE x MAP_CHUNK_SIZE cells, stored one after the other, row
+  * of chunks by row of chunks, and each chunk row by row. This way a chunk can be read in one go. Chunks
+  * on the right and bottom edges are padded out to the full size.
+  *
+  * Each section starts at the offset given in the header, aligned to 8 bytes. The cells are aligned to
+  * 4096 bytes, so every chunk starts on a page of its own. All numbers are stored in the byte order of
+  * the machine that wrote the file (little endian on anything you are likely to run this on).
+  *
+  * mapconv converts a text map to a binary map: mapconv map.txt map.bin
+  */
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <fstream>
+#include <vector>
+
+// The first four bytes of every binary map.
+const char MAP_FILE_MAGIC[4] = {'R', 'P', 'G', 'M'};
+// Bump this whenever the layout below changes.
+const unsigned MAP_FILE_VERSION = 2;
+
+// Maps are stored (and loaded, and kept in memory) in square chunks of this many cells a side.
+const int MAP_CHUNK_SHIFT = 6;
+const int MAP_CHUNK_SIZE  = 1 << MAP_CHUNK_SHIFT;
+const int MAP_CHUNK_CELLS = MAP_CHUNK_SIZE * MAP_CHUNK_SIZE;
+
+// The biggest map we accept, in tiles a side, and the most tiles in a tile table. Bigger maps would
+// overflow the int arithmetic the game does on cell positions.
+const int MAP_MAX_SIZE  = 1 << 15;
+const int MAP_MAX_TILES = 1 << 16;
+
+// We use fixed size types, so that the file has the same layout whatever compiler wrote it.
+typedef int           MapInt;   // 32 bits on every platform we care about.
+typedef unsigned      MapUInt;
+typedef long long     MapOffset;
+
+struct MapFileHeader
+{
+    char     magic[4];      // MAP_FILE_MAGIC.
+    MapUInt  version;       // MAP_FILE_VERSION.
+    MapInt   width, height; // Size of the map, in tiles.
+    MapInt   startX, startY;// Where the player starts.
+    MapUInt  numTiles;      // Entries in the tile table.
+    MapUInt  numChests;     // Entries in the chest table.
+    MapUInt  numEnemies;    // Entries in the enemy table.
+    MapUInt  reserved;      // Keeps the offsets below 8 byte aligned.
+    // Where each section starts, in bytes from the start of the file.
+    MapOffset tilesOffset, mapOffset, chestsOffset, enemiesOffset;
+};
+
+struct MapFileTile
+{
+    // Offset to the image, in pixels.
+    MapUInt offsetX, offsetY;
+    // Non-zero if this tile can be walked on.
+    MapUInt walkable;
+};
+
+struct MapFileChest
+{
+    // Position of the chest.
+    MapInt x, y;
+    // Image offsets for the chest, in tiles.
+    MapInt offsetX, offsetY;
+    // How much gold the chest contains.
+    MapInt gold;
+};
+
+struct MapFileEnemy
+{
+    // Position of the enemy.
+    MapInt x, y;
+};
+
+// Round a file offset up to the next multiple of 'align' (8 unless you say otherwise).
+inline MapOffset mapFileAlign (MapOffset offset, MapOffset align = 8)
+{
+    return (offset + align - 1) & ~(align - 1);
+}
+
+// How many chunks it takes to cover 'cells' cells.
+inline int mapChunks (int cells)
+{
+    return (cells + MAP_CHUNK_SIZE - 1) >> MAP_CHUNK_SHIFT;
+}
+
+// Where the tile index of cell (x, y) is stored, counting in cells from the start of the first chunk.
+inline MapOffset mapCellOffset (int width, int x, int y)
+{
+    MapOffset chunk = MapOffset(y >> MAP_CHUNK_SHIFT) * mapChunks(width) + (x >> MAP_CHUNK_SHIFT);
+    return chunk * MAP_CHUNK_CELLS + ((y & (MAP_CHUNK_SIZE - 1)) << MAP_CHUNK_SHIFT) + (x & (MAP_CHUNK_SIZE - 1));
+}
+
+// Fill in the section offsets of a header, once the counts and the size of the map are known.
+inline void mapFileLayout (MapFileHeader& header)
+{
+    header.tilesOffset   = mapFileAlign(sizeof(MapFileHeader));
+    header.mapOffset     = mapFileAlign(header.tilesOffset + MapOffset(header.numTiles) * sizeof(MapFileTile), 4096);
+    header.chestsOffset  = mapFileAlign(header.mapOffset + MapOffset(mapChunks(header.width)) * mapChunks(header.height) * MAP_CHUNK_CELLS * sizeof(MapInt));
+    header.enemiesOffset = mapFileAlign(header.chestsOffset + MapOffset(header.numChests) * sizeof(MapFileChest));
+}
+
+// Total size of a binary map file with this header.
+inline MapOffset mapFileSize (const MapFileHeader& header)
+{
+    return header.enemiesOffset + MapOffset(header.numEnemies) * sizeof(MapFileEnemy);
+}
+
+// Is the binary map in 'data' ('size' bytes long, with the right magic and version) safe to read? Everything
+// the game reads straight out of the file without looking is checked: the size of the map, where each section
+// is (they must be exactly where mapconv puts them), and that the player, chests and enemies are on the map.
+// The tile of each cell isn't checked here, as that would read the whole file; see readChunk.
+inline bool mapFileValid (const char* data, MapOffset size)
+{
+    const MapFileHeader& header = *(const MapFileHeader*)data;
+    if (header.width < 1 || header.height < 1 || header.width > MAP_MAX_SIZE || header.height > MAP_MAX_SIZE
+        || header.numTiles < 1 || header.numTiles > (MapUInt)MAP_MAX_TILES)
+    {
+        return false;
+    }
+
+    // Work the layout out again from the sizes, and make sure the file agrees with it (and is big enough).
+    MapFileHeader expected = header;
+    mapFileLayout(expected);
+    if (header.tilesOffset != expected.tilesOffset || header.mapOffset != expected.mapOffset
+        || header.chestsOffset != expected.chestsOffset || header.enemiesOffset != expected.enemiesOffset
+        || mapFileSize(expected) > size)
+    {
+        return false;
+    }
+
+    if (header.startX < 0 || header.startY < 0 || header.startX >= header.width || header.startY >= header.height)
+    {
+        return false;
+    }
+    const MapFileChest* chests = (const MapFileChest*)(data + header.chestsOffset);
+    for (MapUInt i = 0; i < header.numChests; ++i)
+    {
+        if (chests[i].x < 0 || chests[i].y < 0 || chests[i].x >= header.width || chests[i].y >= header.height) return false;
+    }
+    const MapFileEnemy* enemies = (const MapFileEnemy*)(data + header.enemiesOffset);
+    for (MapUInt i = 0; i < header.numEnemies; ++i)
+    {
+        if (enemies[i].x < 0 || enemies[i].y < 0 || enemies[i].x >= header.width || enemies[i].y >= header.height) return false;
+    }
+    return true;
+}
+
+// Read a map in the text format into the same records the binary format stores (so 'cells' is in chunk order).
+// Returns false if the file could not be opened.
+inline bool readTextMap (const char* filename, MapFileHeader& header, std::vector<MapFileTile>& tiles, std::vector<MapInt>& cells,
+                         std::vector<MapFileChest>& chests, std::vector<MapFileEnemy>& enemies)
+{
+    std::ifstream file (filename);
+    if (!file)
+    {
+        return false;
+    }
+
+    // First we load the tiles.
+    // A mapping of character tile ID's and tile indices. (to get tile 'A': tiles[tileID['A']])
+    int tileID[256] = {0};
+    // The image offsets of each tile, in tiles rather than pixels. Chests are drawn with these.
+    std::vector<MapFileTile> rawTiles;
+    // These are used to store special tiles, currently only one of each may exist.
+    unsigned char startTile = 0, chestTile = 0, enemyTile = 0;
+
+    char letter, walkable, special;
+    while (file >> letter)
+    {
+        // If the letter is an exclamation mark, we've reached the end of the tile definitions.
+        if (letter == '!') break;
+
+        // Read in the image offsets, and whether the tile can be walked on.
+        MapFileTile temp;
+        file >> temp.offsetX >> temp.offsetY;
+        file >> walkable >> special;
+        temp.walkable = (walkable == 'W' ? 1 : 0);
+
+        // Remember the special entities.
+        if (special == 'S')
+        {
+            // This is the start position.
+            startTile = letter;
+        } else if (special == 'C')
+        {
+            // We gots a treasure chest.
+            chestTile = letter;
+        } else if (special == 'E')
+        {
+            // We have an enemy.
+            enemyTile = letter;
+        }
+
+        // Add the tile to the tile ID map.
+        tileID[(unsigned char)letter] = rawTiles.size();
+        rawTiles.push_back(temp);
+    }
+
+    // The binary format stores image offsets in pixels.
+    tiles = rawTiles;
+    for (unsigned i = 0; i < tiles.size(); ++i)
+    {
+        tiles[i].offsetX *= 32;
+        tiles[i].offsetY *= 32;
+    }
+
+    // Then we load the map.
+    header.width = header.height = 0;
+    header.startX = header.startY = 0;
+    file >> header.width >> header.height;
+    cells.assign(MapOffset(mapChunks(header.width)) * mapChunks(header.height) * MAP_CHUNK_CELLS, 0);
+
+    int count = 0;
+    // Loop through all of the map tile cells.
+    while (count < header.width * header.height && file >> letter)
+    {
+        unsigned char id = letter;
+        int y = count / header.width;
+        int x = count - (y * header.width);
+        // Set the tile of the cell.
+        cells[mapCellOffset(header.width, x, y)] = tileID[id];
+
+        // Now handle special tiles.
+        if (id == startTile)
+        {
+            // This tile is where the player starts.
+            header.startX = x;
+            header.startY = y;
+        } else if (id == chestTile)
+        {
+            // This tile contains a treasure chest.
+            // The last number is how much gold.. We just hard code it to 5 for now.
+            MapFileChest chest = {x, y, (MapInt)rawTiles[tileID['C']].offsetX, (MapInt)rawTiles[tileID['C']].offsetY, 5};
+            chests.push_back(chest);
+        } else if (id == enemyTile)
+        {
+            // This tile contains an enemy.
+            MapFileEnemy enemy = {x, y};
+            enemies.push_back(enemy);
+        }
+        ++count;
+    }
+
+    // Fill in the rest of the header.
+    for (int i = 0; i < 4; ++i)
+    {
+        header.magic[i] = MAP_FILE_MAGIC[i];
+    }
+    header.version    = MAP_FILE_VERSION;
+    header.numTiles   = tiles.size();
+    header.numChests  = chests.size();
+    header.numEnemies = enemies.size();
+    header.reserved   = 0;
+    mapFileLayout(header);
+    return true;
+}
+
+#endif // MAPFILE_H
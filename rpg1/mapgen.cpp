@@ -0,0 +1,137 @@
+/**
+  * Makes up a map of any size, in the text format (map.txt), for trying the game (and rpg1sim) out on maps far
+  * bigger than anyone would draw by hand.
+  *
+  * The map is caves: rock scattered at random, then smoothed out a few times so that it clumps together into
+  * walls, with winding passages in between. Enemies and chests are scattered over the floor, and the player
+  * starts in the middle. The same seed always makes the same map.
+  *
+  * Build:  g++ mapgen.cpp -o mapgen
+  * Usage:  mapgen width height map.txt [seed] [enemies per 100 cells] [chests per 100 cells]
+  *
+  * To see how the game copes with a huge map and lots of enemies chasing the player:
+  *         mapgen 2000 2000 huge.txt && mapconv huge.txt huge.bin
+  *         rpg1sim 100 1 60 huge.bin 40
+  */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// The tiles, the same as in map.txt.
+const char* MAP_TILES =
+    "G 0 0 W 0\n"
+    "T 1 0 B 0\n"
+    "X 2 0 B 0\n"
+    "B 3 0 B 0\n"
+    "P 0 1 B 0\n"
+    "D 1 1 B 0\n"
+    "F 2 1 W 0\n"
+    "W 3 1 B 0\n"
+    "P 0 0 W C\n"
+    "S 0 0 W S\n"
+    "E 0 0 W E\n"
+    "C 0 2 0 0\n"
+    "!\n";
+
+// Our own random number generator, so that a seed makes the same map everywhere. Returns 0 to 32767.
+unsigned int randomState = 1;
+int nextRandom ()
+{
+    randomState = randomState * 1103515245 + 12345;
+    return (randomState >> 16) & 0x7fff;
+}
+
+int main (int argc, char* argv[])
+{
+    int width  = argc > 1 ? std::atoi(argv[1]) : 0;
+    int height = argc > 2 ? std::atoi(argv[2]) : 0;
+    randomState = argc > 4 ? std::atoi(argv[4]) : 1;
+    int enemies = argc > 5 ? std::atoi(argv[5]) : 10;
+    int chests  = argc > 6 ? std::atoi(argv[6]) : 10;
+    if (argc < 4 || width < 1 || height < 1 || enemies < 0 || chests < 0 || enemies + chests > 100)
+    {
+        std::cerr << "Usage: " << argv[0] << " width height map.txt [seed] [enemies per 100 cells] [chests per 100 cells]\n";
+        return 1;
+    }
+
+    // Scatter the rock: a bit under half of the map to start with.
+    std::vector<char> rock (width * height), smoothed (width * height);
+    for (int i = 0; i < width * height; ++i)
+    {
+        rock[i] = nextRandom() % 100 < 45;
+    }
+    // Then smooth it out: a cell becomes rock if most of the cells around it are (the edge of the map counts
+    // as rock), and floor if not.
+    for (int pass = 0; pass < 4; ++pass)
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                int count = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height || rock[ny * width + nx]) count++;
+                    }
+                }
+                smoothed[y * width + x] = count >= 5;
+            }
+        }
+        rock.swap(smoothed);
+    }
+
+    // Write it out, filling the floor with grass, enemies and chests.
+    std::FILE* file = std::fopen(argv[3], "w");
+    if (!file)
+    {
+        std::cerr << "Failed to create " << argv[3] << "\n";
+        return 1;
+    }
+    std::fputs(MAP_TILES, file);
+    std::fprintf(file, "%d %d\n", width, height);
+    int startX = width / 2, startY = height / 2;
+    int numEnemies = 0, numChests = 0;
+    std::vector<char> row (width + 1);
+    row[width] = '\n';
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            int roll = nextRandom() % 100;
+            if (x == startX && y == startY)
+            {
+                // The player always starts in the middle, whatever is there.
+                row[x] = 'S';
+            } else if (rock[y * width + x])
+            {
+                // Rock, or now and then a tree.
+                row[x] = roll < 20 ? 'T' : 'X';
+            } else if (roll < enemies)
+            {
+                row[x] = 'E';
+                numEnemies++;
+            } else if (roll < enemies + chests)
+            {
+                row[x] = 'P';
+                numChests++;
+            } else {
+                row[x] = 'G';
+            }
+        }
+        std::fwrite(&row[0], 1, row.size(), file);
+    }
+    if (std::fclose(file) != 0)
+    {
+        std::cerr << "Failed to write " << argv[3] << "\n";
+        return 1;
+    }
+
+    std::cout << argv[3] << ": " << width << "x" << height << " tiles, "
+              << numChests << " chests, " << numEnemies << " enemies\n";
+    return 0;
+}
@@ -1,81 +1,27 @@
-
 /**
   * An old RPG-like dungeon crawler I wrote back in ~2006 as a demonstration of a simple SDL-based game.
   */
 
 #include <iostream>     // We use this to print errors to std::cerr.
+#include <cstdio>
 #include <cstdlib>
-#include <fstream>      // We use this to load our map.
+#include <algorithm>    // We use std::swap, std::max, std::stable_sort and std::equal.
 #include <vector>       // We use this to store a list of enemies and items.
 
 #include <SDL/SDL.h>    // We use this for input and graphics.
 
+#include "game.h"       // The game itself: the map, the player, the enemies, and everything they do.
+
 // Various graphical surfaces.
 SDL_Surface* screen = NULL; // The screen.
 SDL_Surface* font   = NULL; // Text Font.
 SDL_Surface* tiles  = NULL; // Background Tiles.
 SDL_Surface* charas = NULL; // Characters.
 
-// Set this to whatever you want the enemies health to be.
-const int ENEMY_MAX_HEALTH = 3;
-
-// The most important data structure in the game.
-struct Tile
-{
-    // Offset to image.
-    unsigned offsetX, offsetY;
-    // If true, this tile can be walked on.
-    bool walkable;
-};
-
-// The second most important data structure in the game.
-struct Map
-{
-    int numTiles;       // How many different tiles?
-    Tile* tiles;        // Store the tiles.
-    int width, height;  // Width and height of the map, in tiles.
-    int* map;           // Indices into the array of tiles.
-    bool* blocked;      // These map cells are temporarily blocked (ie: there is an enemy standing there).
-};
-
-// The third most important data structure in the game.
-struct Character
-{
-    // Self-explanatory.
-    int health;
-    
-    // Current position on the map.
-    int x, y;
-    
-    // Offset to the image to be used.
-    int image;
-    
-    // Parameter. We use this to manage frequency of enemy attacks. You can use it for other things for other character types.
-    unsigned int parameter;
-};
-
-// Used to track the scrolling of the map (Try editing map.txt to create a huge map to see this in action).
-struct Position
-{
-    int x, y;
-};
-
-struct Item
-{
-    // Position of the item.
-    int x, y;
-    
-    // Image offsets for the item.
-    int offsetX, offsetY;
-    
-    // Type of item.
-    int type; // In this version, all items are chests, so type is how much gold the chest contains. Use your imagination here though.
-};
-
-// Draw part of a surface to the screen.
+// Draw part of a surface to the screen (or to 'target', if given).
 // (x, y)                 = Where on the screen to draw.
 // (x2, y2)->(x2+w, y2+h) = Rectangle of 'img' to be drawn.
-void draw (SDL_Surface* img, int x, int y, int w, int h, int x2, int y2)
+void draw (SDL_Surface* img, int x, int y, int w, int h, int x2, int y2, SDL_Surface* target = NULL)
 {
     SDL_Rect src;
     SDL_Rect dest;
@@ -92,7 +38,7 @@ void draw (SDL_Surface* img, int x, int y, int w, int h, int x2, int y2)
     
     // Draw all pixels in the 'src' rectangle from 'img' to the 'dest' rectangle in 'screen'.
     // Note: dest only has the x and y set. The width and height of the destination will be the same as the source.
-    SDL_BlitSurface(img, &src, screen, &dest);
+    SDL_BlitSurface(img, &src, target ? target : screen, &dest);
 }
 
 // Load an image.
@@ -159,235 +105,286 @@ void drawText (unsigned int x, unsigned int y, unsigned int width, const char* t
     }
 }
 
-// This loads a game map from disk into the internal map data structure.
-// This is by far the most complex function in this game.
-void loadMap (Map& map, int& startX, int& startY, std::vector<Item>& items, std::vector<Character>& enemies, const char* filename)
+// Fill a rectangle of the screen (or of 'target', if given) with a colour.
+void fill (int x, int y, int w, int h, Uint32 colour, SDL_Surface* target = NULL)
 {
-    std::ifstream file (filename);
-
-    // First we load the tiles.
-    // A mapping of character tile ID's and tile indices. (to get tile 'A': tiles[tileID['A']])
-    int tileID[256];
-    // These are used to store special tiles, currently only one of each may exist.
-    char startTile, chestTile, enemyTile;
-    // The actual tile data is stored in this vector.
-    std::vector<Tile> tiles;
-    
-    char letter, walkable, special;
-    while (true)
-    {
-        Tile temp;
-        // Read in the next tile.
-        file >> letter;
-        
-        // If the letter is an exclamation mark, we've reached the end of the tile definitions.
-        if (letter == '!') break;
+    SDL_Rect rect;
+    rect.x = x;
+    rect.y = y;
+    rect.w = w;
+    rect.h = h;
+    SDL_FillRect(target ? target : screen, &rect, colour);
+}
 
-        // Read in the rest of the definition.
-        // Read in the image offsets.
-        file >> temp.offsetX >> temp.offsetY;
-        file >> walkable >> special;
-        temp.walkable = (walkable == 'W' ? true : false);
+// Where the map goes on the screen, and how big it is in pixels (VIEW_SIZE x VIEW_SIZE tiles of 32x32).
+const int VIEW_X = 128;
+const int VIEW_Y = 0;
+const int VIEW_PIXELS = VIEW_SIZE * 32;
 
-        if (special != '0')
-        {
-            // We have a special entity.
-            if (special == 'S')
-            {
-                // This is the start position.
-                startTile = letter;
-            } else if (special == 'C')
-            {
-                // We gots a treasure chest.
-                chestTile = letter;
-            } else if (special == 'E')
-            {
-                // We have an enemy.
-                enemyTile = letter;
-            }
-                
-        }
-
-        // add the tile to the tile ID map.
-        tileID[letter] = tiles.size();
-        tiles.push_back(temp);
-    }
+// Something drawn over the map: an item, an enemy or the player.
+struct Sprite
+{
+    int x, y;               // Where it is on the screen.
+    SDL_Surface* image;     // Which image it is,
+    int offsetX, offsetY;   // and where in the image, in pixels.
 
-    // Allocate space for the tiles in the map data structure.
-    map.numTiles = tiles.size();
-    map.tiles = new Tile[map.numTiles];
-    
-    // Copy the tiles into the map's tile structure.
-    for (int i = 0; i < map.numTiles; ++i)
+    bool operator== (const Sprite& other) const
     {
-        map.tiles[i].offsetX  = tiles[i].offsetX * 32;
-        map.tiles[i].offsetY  = tiles[i].offsetY * 32;
-        map.tiles[i].walkable = tiles[i].walkable;
+        return x == other.x && y == other.y && image == other.image && offsetX == other.offsetX && offsetY == other.offsetY;
     }
-    
-    //Then we load the map.
-    file >> map.width >> map.height;
-    
-    // Allocate space for the map and the blocked flags.
-    map.map = new int[map.height * map.width];
-    map.blocked = new bool[map.height * map.width];
-    
-    int count = 0;
-    // Loop through all of the map tile cells.
-    while (count < map.width * map.height && !file.eof())
+};
+
+// Sprites are kept in order of where they are, row by row, so that the sprites in a tile are next to each other.
+// (Sprites in the same tile keep the order they're drawn in.)
+bool spriteBefore (const Sprite& a, const Sprite& b)
+{
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+// How many sprites from 'from' onwards are in tile (x, y) of the screen.
+unsigned int spritesAt (const std::vector<Sprite>& sprites, unsigned int from, int x, int y)
+{
+    unsigned int to = from;
+    while (to < sprites.size() && sprites[to].x == x && sprites[to].y == y)
     {
-        // Read in the tile ID character.
-        file >> letter;
-        // Set the tile in the map data structure.
-        map.map[count] = tileID[letter];
-        // By default all tiles are unblocked.
-        map.blocked[count] = false;
-        
-        // Now handle special tiles.
-        if (letter == startTile)
-        {
-            // This tile is where the player starts.
-            startY = count / map.width;
-            startX = count - (startY * map.width);
-        } else if (letter == chestTile)
-        {
-            // This tile is a contains a treasure chest.
-            int tempY = count / map.width;
-            int tempX = count - (tempY * map.width);
-            // The last number is how much gold.. We just hard code it to 5 for now.
-            Item chest = {tempX, tempY, tiles[tileID['C']].offsetX, tiles[tileID['C']].offsetY, 5};
-            items.push_back(chest);
-        } else if (letter == enemyTile)
-        {
-            // This tile contains an enemy.
-            int tempY = count / map.width;
-            int tempX = count - (tempY * map.width);
-            Character enemy = {ENEMY_MAX_HEALTH, tempX, tempY, 64, 0};
-            enemies.push_back(enemy);
-        }
-        ++count;
+        ++to;
     }
-    
+    return to - from;
 }
 
-// Draw the map. The x and y are used to position the map on the screen.
-void drawMap (Map& map, unsigned int x, unsigned int y)
+// Remembers what is on the screen, so that each frame we only draw what changed, and only send the parts of
+// the screen that changed to the display. Most frames nothing changes at all, and we draw nothing.
+struct Renderer
 {
-    int posx = 128;
-    int posy = 0;
-    int tile;
-    int tileID;
-    
-    // Loop through all Y-coordinates of tiles in range of the screen.
-    for (int yy = y; yy < y+12 && yy < map.height; ++yy)
+    SDL_Surface* map;               // The map in view, with nothing on it, just as it is on the screen.
+    SDL_Surface* spare;             // When the view scrolls, we draw the scrolled map in here, then swap it with 'map'.
+    Position view;                  // Which part of the map 'map' holds.
+    bool drawn;                     // False until we've drawn the first frame.
+    std::vector<Sprite> sprites;    // What is drawn over the map, in the order spriteBefore puts them in.
+    int gold, health, enemyHealth;  // What the HUD shows. An enemyHealth of -1 means no enemy health meter.
+    bool over;                      // The game over text is showing.
+    std::vector<int> found;         // Used to hold what we find in the grids.
+    std::vector<SDL_Rect> dirty;    // The parts of the screen we changed this frame.
+};
+
+// Make the surfaces the renderer draws the map in. They're just like the screen, but off it.
+void startRenderer (Renderer& r)
+{
+    SDL_PixelFormat* format = screen->format;
+    r.map   = SDL_CreateRGBSurface(SDL_SWSURFACE, VIEW_PIXELS, VIEW_PIXELS, format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+    r.spare = SDL_CreateRGBSurface(SDL_SWSURFACE, VIEW_PIXELS, VIEW_PIXELS, format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+    r.view.x = r.view.y = 0;
+    r.drawn = false;
+    r.over = false;
+}
+
+void stopRenderer (Renderer& r)
+{
+    SDL_FreeSurface(r.map);
+    SDL_FreeSurface(r.spare);
+}
+
+// Note that part of the screen changed, so that it is sent to the display at the end of the frame.
+void markDirty (Renderer& r, int x, int y, int w, int h)
+{
+    SDL_Rect rect;
+    rect.x = x;
+    rect.y = y;
+    rect.w = w;
+    rect.h = h;
+    r.dirty.push_back(rect);
+}
+
+// Draw the tiles of the view from column fromX and row fromY, up to (not including) column toX and row toY,
+// into the renderer's map.
+void drawMapTiles (Renderer& r, Map& map, int fromX, int fromY, int toX, int toY)
+{
+    // Black first: anything off the edge of the map stays black.
+    fill(fromX * 32, fromY * 32, (toX - fromX) * 32, (toY - fromY) * 32, 0, r.map);
+    for (int yy = fromY; yy < toY; ++yy)
     {
-        // Calculate the index of the first tile on the row (row YY, column 0 - on screen, not overall).
-        tile = (yy * map.width) + x;
-        
-        // Loop through all X-coordinates of tiles in range of the screen.
-        for (int xx = x; xx < x+12 && xx < map.width; ++xx)
+        for (int xx = fromX; xx < toX; ++xx)
         {
+            if (!onMap(map, r.view.x + xx, r.view.y + yy)) continue;
             // Get the tile ID.
-            tileID = map.map[tile];
+            int tileID = tileAt(map, r.view.x + xx, r.view.y + yy);
             // Draw the tile.
-            draw(tiles, posx, posy, 32, 32, map.tiles[tileID].offsetX, map.tiles[tileID].offsetY);
-            // Advance the position on the screen.
-            posx += 32;
-            // Move to the next tile.
-            ++tile;
+            draw(tiles, xx * 32, yy * 32, 32, 32, map.tiles[tileID].offsetX, map.tiles[tileID].offsetY, r.map);
         }
-        // Advance the on screen position to the next row.
-        posy += 32;
-        posx = 128;
     }
 }
 
-// Draw the enemies.
-int drawEnemies (Map& map, std::vector<Character>& goblins, unsigned int x, unsigned int y, unsigned int px, unsigned int py)
+// Bring the renderer's map up to date with the view. When the view scrolls a tile, all but one row or column
+// of the map we have is still good: we just move it over, and draw the tiles that came into view.
+void scrollMap (Renderer& r, Map& map, Position view)
 {
-    int damage = 0;
-    // Loop through all enemies.
-    for (int i = 0; i < goblins.size(); ++i)
+    int dx = view.x - r.view.x, dy = view.y - r.view.y;
+    r.view = view;
+    if (!r.drawn || std::abs(dx) >= VIEW_SIZE || std::abs(dy) >= VIEW_SIZE)
     {
-        // If the enemy is in range of the screen...
-        if (goblins[i].x >= x && goblins[i].x < x+12 &&
-            goblins[i].y >= y && goblins[i].y < y+12)
+        // Nothing we have is still in view. Draw it all.
+        drawMapTiles(r, map, 0, 0, VIEW_SIZE, VIEW_SIZE);
+        return;
+    }
+
+    // Move what's still in view to where it is now. We move it into the spare surface, as a surface can't be
+    // drawn onto itself when the two parts overlap.
+    draw(r.map, std::max(-dx, 0) * 32, std::max(-dy, 0) * 32, (VIEW_SIZE - std::abs(dx)) * 32, (VIEW_SIZE - std::abs(dy)) * 32,
+         std::max(dx, 0) * 32, std::max(dy, 0) * 32, r.spare);
+    std::swap(r.map, r.spare);
+
+    // Then draw the columns and rows that came into view.
+    if (dx > 0) drawMapTiles(r, map, VIEW_SIZE - dx, 0, VIEW_SIZE, VIEW_SIZE);
+    if (dx < 0) drawMapTiles(r, map, 0, 0, -dx, VIEW_SIZE);
+    if (dy > 0) drawMapTiles(r, map, 0, VIEW_SIZE - dy, VIEW_SIZE, VIEW_SIZE);
+    if (dy < 0) drawMapTiles(r, map, 0, 0, VIEW_SIZE, -dy);
+}
+
+// Draw a frame of the game, and send the parts of the screen that changed to the display.
+void renderFrame (Renderer& r, Game& game)
+{
+    if (!r.drawn)
+    {
+        // The first frame. Start with a black screen, and the parts of the HUD that never change.
+        SDL_FillRect(screen, NULL, 0);
+        // The gold icon.
+        draw(tiles, 144, 416, 32, 32, 32, 64);
+        markDirty(r, 0, 0, screen->w, screen->h);
+    }
+
+    // The map.
+    bool scrolled = !r.drawn || game.view.x != r.view.x || game.view.y != r.view.y;
+    if (scrolled)
+    {
+        scrollMap(r, game.map, game.view);
+    }
+
+    // What's on the map: the items, then the enemies, then the player.
+    std::vector<Sprite> sprites;
+    findInGrid(game.itemGrid, game.items, game.view.x, game.view.y, VIEW_SIZE, VIEW_SIZE, r.found);
+    for (unsigned int n = 0; n < r.found.size(); ++n)
+    {
+        const Item& item = game.items[r.found[n]];
+        Sprite sprite = {VIEW_X + (item.x - game.view.x) * 32, VIEW_Y + (item.y - game.view.y) * 32, tiles, item.offsetX * 32, item.offsetY * 32};
+        sprites.push_back(sprite);
+    }
+    findInGrid(game.enemyGrid, game.enemies, game.view.x, game.view.y, VIEW_SIZE, VIEW_SIZE, r.found);
+    for (unsigned int n = 0; n < r.found.size(); ++n)
+    {
+        const Character& goblin = game.enemies[r.found[n]];
+        Sprite sprite = {VIEW_X + (goblin.x - game.view.x) * 32, VIEW_Y + (goblin.y - game.view.y) * 32, charas, 64, 0};
+        sprites.push_back(sprite);
+    }
+    Sprite player = {VIEW_X + (game.player.x - game.view.x) * 32, VIEW_Y + (game.player.y - game.view.y) * 32, charas, game.player.image * 32, 0};
+    sprites.push_back(player);
+    std::stable_sort(sprites.begin(), sprites.end(), spriteBefore);
+
+    if (scrolled)
+    {
+        // All of the map moved, so put all of it on the screen, with everything on top.
+        draw(r.map, VIEW_X, VIEW_Y, VIEW_PIXELS, VIEW_PIXELS, 0, 0);
+        for (unsigned int i = 0; i < sprites.size(); ++i)
         {
-            // Process the enemy.
-
-            // Unblock their current location.
-            map.blocked[goblins[i].x + (goblins[i].y * map.width)] = false;
-            
-            // If the enemy is in range of the player...
-            if (goblins[i].x >= px-1 && goblins[i].x <= px+1 &&
-                goblins[i].y >= py-1 && goblins[i].y <= py+1)
-            {
-                // Enemy in range. Potentially attack.
-                if (SDL_GetTicks() - goblins[i].parameter >= 750)
-                {
-                    // ATTACK!
-                    damage++;
-                    goblins[i].parameter = SDL_GetTicks();
-                }
-            } else if (SDL_GetTicks() - goblins[i].parameter >= 1000)
+            draw(sprites[i].image, sprites[i].x, sprites[i].y, 32, 32, sprites[i].offsetX, sprites[i].offsetY);
+        }
+        markDirty(r, VIEW_X, VIEW_Y, VIEW_PIXELS, VIEW_PIXELS);
+    } else
+    {
+        // Go through the tiles with sprites in them, last frame or this one (both lists are in tile order), and
+        // redraw only the tiles whose sprites changed: the map back over what was there, then what is there now.
+        unsigned int last = 0, now = 0;
+        while (last < r.sprites.size() || now < sprites.size())
+        {
+            // The next tile with a sprite in it.
+            const Sprite& next = now == sprites.size() || (last < r.sprites.size() && spriteBefore(r.sprites[last], sprites[now])) ? r.sprites[last] : sprites[now];
+            int x = next.x, y = next.y;
+            unsigned int lastCount = spritesAt(r.sprites, last, x, y);
+            unsigned int nowCount = spritesAt(sprites, now, x, y);
+            if (lastCount != nowCount || !std::equal(sprites.begin() + now, sprites.begin() + now + nowCount, r.sprites.begin() + last))
             {
-                // Enemy is not in range, but it's ready for an action.
-                
-                // Move in a random direction.
-                switch (std::rand() % 5)
+                draw(r.map, x, y, 32, 32, x - VIEW_X, y - VIEW_Y);
+                for (unsigned int i = now; i < now + nowCount; ++i)
                 {
-                    case 0:
-                        // If the new position is walkable and not blocked, move the enemy.
-                        if (!map.blocked[(goblins[i].x + 1) + (goblins[i].y * map.width)] &&
-                             map.tiles[map.map[(goblins[i].x + 1) + (goblins[i].y * map.width)]].walkable)
-                            goblins[i].x += 1;
-                    break; case 1:
-                        if (!map.blocked[(goblins[i].x - 1) + (goblins[i].y * map.width)] &&
-                             map.tiles[map.map[(goblins[i].x - 1) + (goblins[i].y * map.width)]].walkable)
-                            goblins[i].x -= 1;
-                    break; case 2:
-                        if (!map.blocked[(goblins[i].x) + ((goblins[i].y+1) * map.width)] &&
-                             map.tiles[map.map[(goblins[i].x) + ((goblins[i].y+1) * map.width)]].walkable)
-                            goblins[i].y += 1;
-                    break; case 3:
-                        if (!map.blocked[(goblins[i].x) + ((goblins[i].y-1) * map.width)] &&
-                             map.tiles[map.map[(goblins[i].x) + ((goblins[i].y-1) * map.width)]].walkable)
-                            goblins[i].y -= 1;
-                    break; default: break;
+                    draw(sprites[i].image, x, y, 32, 32, sprites[i].offsetX, sprites[i].offsetY);
                 }
-                // Reset its action timer.
-                goblins[i].parameter = SDL_GetTicks();
+                markDirty(r, x, y, 32, 32);
             }
-            // Set its current position to blocked.
-            map.blocked[goblins[i].x + (goblins[i].y * map.width)] = true;
-
-            //Draw the enemy.
-            draw(charas, 128 + ((goblins[i].x - x) * 32), (goblins[i].y - y) * 32, 32, 32, 64, 0);
+            last += lastCount;
+            now += nowCount;
         }
     }
-    return damage;
-}
+    r.sprites.swap(sprites);
 
-// Draw items.
-void drawItems (std::vector<Item>& items, unsigned int x, unsigned int y)
-{
-    // Loop through all items (treasure chests).
-    for (int i = 0; i < items.size(); ++i)
+    // The players gold count. The text can run into the meters, so if it's drawn, the meters are drawn over it.
+    bool goldChanged = !r.drawn || game.gold != r.gold;
+    if (goldChanged)
     {
-        // If they are in range of the screen...
-        if (items[i].x >= x && items[i].x < x+12 &&
-            items[i].y >= y && items[i].y < y+12)
-        {
-            // We draw them.
-            draw(tiles, 128 + ((items[i].x - x) * 32), (items[i].y - y) * 32, 32, 32, items[i].offsetX * 32, items[i].offsetY * 32);
-        }
+        r.gold = game.gold;
+        char goldString[16];
+        sprintf(goldString, "%d", r.gold);
+        fill(184, 416, 100, 64, 0);
+        drawText(184, 416, 100, goldString);
+        markDirty(r, 184, 416, 100, 64);
+    }
+
+    // The health meter.
+    bool healthChanged = goldChanged || game.player.health != r.health;
+    if (healthChanged)
+    {
+        r.health = game.player.health;
+        fill(272, 432, 240, 16, 0);
+        fill(272, 432, std::max(r.health, 0) * 24, 16, SDL_MapRGB(screen->format, 0, 0, 255));
+        markDirty(r, 272, 432, 240, 16);
+    }
+
+    // If we are beside an enemy, we show it's health meter. We can only show one, so we take the first.
+    findInGrid(game.enemyGrid, game.enemies, game.player.x-1, game.player.y-1, 3, 3, r.found);
+    int enemyHealth = r.found.empty() ? -1 : game.enemies[r.found[0]].health;
+    if (goldChanged || enemyHealth != r.enemyHealth)
+    {
+        r.enemyHealth = enemyHealth;
+        fill(272, 416, 240, 8, 0);
+        if (enemyHealth >= 0) fill(272, 416, enemyHealth * (240 / ENEMY_MAX_HEALTH), 8, SDL_MapRGB(screen->format, 255, 0, 0));
+        markDirty(r, 272, 416, 240, 8);
+    }
+
+    // Player death. The text goes over the health meter, so if that was drawn, so is the text.
+    if (game.over && (!r.over || healthChanged))
+    {
+        r.over = true;
+        drawText(304, 432, 200, "Game Over!");
+        markDirty(r, 304, 432, 200, 32);
+    }
+
+    // Send what changed to the display.
+    r.drawn = true;
+    if (!r.dirty.empty())
+    {
+        SDL_UpdateRects(screen, r.dirty.size(), &r.dirty[0]);
+        r.dirty.clear();
     }
 }
 
+// The longest we sleep for at once, in milliseconds, so that we never oversleep enough to think we fell behind.
+const int MAX_SLEEP = 500;
+
+// Called (on SDL's timer thread) when it's time for the game to do something: wake the main loop up by sending
+// it an event.
+Uint32 wakeUp (Uint32 interval, void* param)
+{
+    SDL_Event event;
+    event.type = SDL_USEREVENT;
+    event.user.code = 0;
+    event.user.data1 = event.user.data2 = NULL;
+    SDL_PushEvent(&event);
+    // Only once.
+    return 0;
+}
+
 int main (int argc, char* argv[])
 {
-    // Initialise SDL.
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
+    // Initialise SDL. We use the timer to wake ourselves up.
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) < 0)
     {
         std::cerr << "Failed to initialise SDL: " << SDL_GetError();
         return 0;
@@ -395,263 +392,120 @@ int main (int argc, char* argv[])
     
     // Set the video mode (ie: initialise the screen for drawing).
     // Set the resolution to 640x480 and the colour depth to 16 bits per pixel (65K Colours)
-    // Enable double buffering. To run in fullscreen, uncomment SDL_FULLSCREEN.
-    screen = SDL_SetVideoMode(640, 480, 16, /*SDL_FULLSCREEN |*/ SDL_DOUBLEBUF | SDL_HWSURFACE);
+    // No double buffering: we only send the parts of the screen that changed to the display (SDL_UpdateRects),
+    // and that needs the screen to stay as we left it. To run in fullscreen, uncomment SDL_FULLSCREEN.
+    screen = SDL_SetVideoMode(640, 480, 16, /*SDL_FULLSCREEN |*/ SDL_SWSURFACE);
 
     // Set the windows caption.
     SDL_WM_SetCaption("RPG 1: Loading...", NULL);
 
-    srand(SDL_GetTicks());
-
     // Load the images used for the game.
     font  = loadImage("font.bmp");
     tiles = loadImage("tiles.bmp");
     charas= loadImage("chara.bmp");
 
-    // Keep track of the scrolling of the background.
-    Position scroll = {0, 0};
+    // Keeps track of what is on the screen.
+    Renderer renderer;
+    startRenderer(renderer);
 
-    // The player.
-    Character player = {10, 0, 0, 0, 0};
-    int gold = 0; // Keep track of the players gold.
-    
-    // Items (well... treasure chests).
-    std::vector<Item> items;
+    // The game: the map, the player, the items and the enemies.
+    Game game;
     
-    // Enemies.
-    std::vector<Character> enemies;
-    
-    // The map.
-    Map map;
-    
-    // Load the map.
-    loadMap(map, player.x, player.y, items, enemies, "map.txt");
+    // Load the map. We prefer the binary map (run "mapconv map.txt map.bin" to make it), as it loads instantly.
+    // The seed is the time, so each game plays out differently.
+    if (!newGame(game, "map.bin", SDL_GetTicks()) &&
+        !newGame(game, "map.txt", SDL_GetTicks()))
+    {
+        std::cerr << "Failed to load the map.";
+        return 0;
+    }
 
     // Set the windows caption.
     SDL_WM_SetCaption("RPG 1  [Press Escape To Quit]", NULL);
 
-    // We use this to limit the amount of input events we allow per second.
-    unsigned int lastInput = 0;
-
     // We use this later to check if keys are pushed down or not.
     Uint8* keys = SDL_GetKeyState(NULL);
 
-    char goldString[8] = {'0',}; // Used to store the string to be printed, done so we dont need to recompute.
-    bool attack = false;         // Flag used to force the player to tap the space bar to attack.
-    bool gotInput = false;       // Flag used to block all further input until timer has reset.
-    bool willHaveInput = false;  // Used to tell the input timer set logic to run.
+    // The game runs in steps of TICK_MS. This is the real time up to which we have run it.
+    unsigned int gameClock = SDL_GetTicks();
+
     bool gameRunning = true;     // Flag used to determine if the game is running or if it should terminate.
     bool gameOver = false;       // If this is set, a game-over screen will appear after the game terminates.
-    SDL_Rect healthMeter = {272, 432, 0, 16}; // This rectangle represents the health meter. We don't recompute this if not needed.
+    SDL_Event event;
     
     // Main game loop.
     while (gameRunning)
     {
-        // Update the 'keys' array with new input data.
-        SDL_PumpEvents();
-
-        // If 1/4 of a second has passed since the last time we processed input, then we are ready to accept input again.
-        if (SDL_GetTicks() - lastInput > 250)
+        // See what happened since we last looked. This also updates the 'keys' array with new input data.
+        while (SDL_PollEvent(&event))
         {
-            gotInput = false;
+            // The window was closed.
+            if (event.type == SDL_QUIT) gameRunning = false;
         }
-        
-        // If we have not already recieved input and the up key is pushed down...
-        if (!gotInput && keys[SDLK_UP])
-        {
-            // The player wants to move up.
-            if (map.tiles[map.map[((player.y-1)*map.width)+(player.x)]].walkable
-                && !map.blocked[((player.y-1)*map.width)+(player.x)]) player.y -= 1;
-            willHaveInput = true;
-        }
-        if (!gotInput && keys[SDLK_DOWN])
-        {
-            // The player wants to move down.
-            if (map.tiles[map.map[((player.y+1)*map.width)+(player.x)]].walkable
-                && !map.blocked[((player.y+1)*map.width)+(player.x)]) player.y += 1;
-            willHaveInput = true;
-        }
-        if (!gotInput && keys[SDLK_RIGHT])
+
+        // Pass the keys the player is holding down on to the game.
+        Input input;
+        input.up     = keys[SDLK_UP] != 0;
+        input.down   = keys[SDLK_DOWN] != 0;
+        input.left   = keys[SDLK_LEFT] != 0;
+        input.right  = keys[SDLK_RIGHT] != 0;
+        input.attack = keys[SDLK_SPACE] != 0;
+
+        // Run the game for however many steps have passed in real time since we last did.
+        unsigned int now = SDL_GetTicks();
+        if (now - gameClock > 1000)
         {
-            // The player wants to move right.
-            if (map.tiles[map.map[((player.y)*map.width)+(player.x+1)]].walkable
-                && !map.blocked[((player.y)*map.width)+(player.x+1)]) player.x += 1;
-            willHaveInput = true;
+            // We fell far behind (the window was being dragged, maybe). Don't try to catch up, just carry on.
+            gameClock = now - TICK_MS;
         }
-        if (!gotInput && keys[SDLK_LEFT])
+        while (now - gameClock >= TICK_MS && !game.over)
         {
-            // The player wants to move left.
-            if (map.tiles[map.map[((player.y)*map.width)+(player.x-1)]].walkable
-                && !map.blocked[((player.y)*map.width)+(player.x-1)]) player.x -= 1;
-            willHaveInput = true;
-        }
-        if (keys[SDLK_SPACE])
-        {
-            if (!gotInput && !attack)
-            {
-                attack = true;
-                
-                // The player wants to attack.
-                willHaveInput = true;
-
-                // Check is there anything adjacent to tyhe players position.
-                if (map.blocked[((player.y-1)*map.width)+(player.x)] ||
-                    map.blocked[((player.y+1)*map.width)+(player.x)] ||
-                    map.blocked[((player.y)*map.width)+(player.x-1)] ||
-                    map.blocked[((player.y)*map.width)+(player.x+1)] ||
-                    map.blocked[((player.y-1)*map.width)+(player.x+1)] ||
-                    map.blocked[((player.y+1)*map.width)+(player.x+1)] ||
-                    map.blocked[((player.y-1)*map.width)+(player.x-1)] ||
-                    map.blocked[((player.y+1)*map.width)+(player.x-1)])
-                {
-                    // Yes, there is.
-                    // Loop through all enemies.
-                    for (int i = 0; i < enemies.size(); i++)
-                    {
-                        // If the enemy is in range of the player...
-                        if (enemies[i].x >= player.x-1 && enemies[i].x <= player.x+1 &&
-                            enemies[i].y >= player.y-1 && enemies[i].y <= player.y+1)
-                        {
-                            // Now we know which enemy to attack.
-                            // Decrease it's health.
-                            enemies[i].health -= 1;
-                            // If it's health is zero...
-                            if (enemies[i].health <= 0)
-                            {
-                                // The enemy has died, remove it from the list.
-                                // Unblock the current location.
-                                map.blocked[((enemies[i].y)*map.width)+(enemies[i].x)] = false;
-                                // And delete the enemy from the enemy list.
-                                enemies.erase(enemies.begin() + i);
-                            }
-                            // We can only attack one enemy at a time, so we can stop searching.
-                            break;
-                        }
-                    }
-                }
-            }
-            
-            // Check treasure chests, in case the player wanted to get ggold from a chest.
-            // Loop through all items.
-            for (int i = 0; i < items.size(); ++i)
-            {
-                // If the item is on the same tile as the enemy...
-                if (player.x == items[i].x && player.y == items[i].y)
-                {
-                    // We found a chest.
-                    // Get the gold.
-                    gold += items[i].type;
-                    // Remove the item from the list.
-                    items.erase(items.begin() + i);
-                    // Update the gold text.
-                    sprintf(goldString, "%d", gold);
-                    // there can only be one item on a tile, so we can stop searching.
-                    break;
-                }
-            }
-        } else {
-            // The player is not pressing the spacebar.
-            attack = false;
-        }
-        
-        // We have recieved input, update the timer and scroll the tilemap, if needs be.
-        if (willHaveInput)
-        {
-            gotInput = true;
-            willHaveInput = false;
-            lastInput = SDL_GetTicks();
-
-            // The player has moved (most likely..), we may need to scroll the map.
-            // If the player is near the edge of the screen and the map is not yet fully scrolled, scroll it.
-            // C position first. To the left.
-            if (player.x - scroll.x < 3 && scroll.x > 0)
-            {
-                scroll.x--;
-                // And to the right.
-            } else if (player.x - scroll.x > 8 && scroll.x < map.width-12)
-            {
-                scroll.x++;
-            }
-            // Then Y position. Left.
-            if (player.y - scroll.y < 3 && scroll.y > 0)
-            {
-                scroll.y--;
-                // And right.
-            } else if (player.y - scroll.y > 8 && scroll.y < map.height-12)
-            {
-                scroll.y++;
-            }
+            stepGame(game, input);
+            gameClock += TICK_MS;
         }
 
-        // Clear the screen to black before drawing to it.
-        SDL_FillRect(screen, NULL, 0);
-        
-        // Draw the background map.
-        drawMap(map, scroll.x, scroll.y);
-        
-        // Draw all the items.
-        drawItems(items, scroll.x, scroll.y);
-        
-        // Draw all the enemies.
-        player.health -= drawEnemies(map, enemies, scroll.x, scroll.y, player.x, player.y);
-        // Player death.
-        if (player.health <= 0)
+        // Draw whatever changed.
+        renderFrame(renderer, game);
+        // Player death. (renderFrame has drawn the game over text.)
+        if (game.over)
         {
             gameOver = true;
             gameRunning = false;
-            drawText(304, 432, 200, "Game Over!");
         }
 
-        // Draw the player.
-        draw(charas, 128 + ((player.x-scroll.x)*32), (player.y-scroll.y)*32, 32, 32, player.image*32, 0);
+        // If escape was pressed, we bail out.
+        if (keys[SDLK_ESCAPE]) gameRunning = false;
+        if (!gameRunning) break;
 
-        // Draw the players gold count.
-        draw(tiles, 144, 416, 32, 32, 32, 64);
-        drawText(184, 416, 100, goldString);
-        
-        // Draw the health meter.
-        healthMeter.w = player.health * 24;
-        SDL_FillRect(screen, &healthMeter, SDL_MapRGB(screen->format, 0, 0, 255));
-        
-        // Loop through all enemies...
-        for (int i = 0; i < enemies.size(); i++)
+        // Nothing changes until the game's next event is due, or a key is pressed or let go, so sleep till then
+        // rather than going round and round for nothing.
+        unsigned int next = nextEvent(game, input);
+        SDL_TimerID timer = NULL;
+        if (next != NO_EVENT)
         {
-            // and check are they in attach range of the player...
-            if (enemies[i].x >= player.x-1 && enemies[i].x <= player.x+1 &&
-                enemies[i].y >= player.y-1 && enemies[i].y <= player.y+1)
-            {
-                // If so, we are beside an enemy, so we want to draw it's health meter.
-                // Create a rectangle to represent the enemies health meter.
-                SDL_Rect enemyMeter = {272, 416, enemies[i].health * (240 / ENEMY_MAX_HEALTH), 8};
-                // And draw it.
-                SDL_FillRect(screen, &enemyMeter, SDL_MapRGB(screen->format, 255, 0, 0));
-                // We can only draw one enemies health meter at a time, so we can stop checking.
-                break;
-            }
+            // When real time will have caught up with the event.
+            int wait = (int)(gameClock + (next - game.time) - SDL_GetTicks());
+            if (wait <= 0) continue;
+            timer = SDL_AddTimer(std::min(wait, MAX_SLEEP), wakeUp, NULL);
         }
-
-        // Switch back buffer and screen - ie: display what we've just drawn.
-        SDL_Flip(screen);
-
-        // If escape was pressed, we bail out.
-        if (keys[SDLK_ESCAPE]) gameRunning = false;
+        SDL_WaitEvent(NULL);
+        if (timer != NULL) SDL_RemoveTimer(timer);
     }
 
     // If the player died, we want to pause on the game over screen until the player presses escape.
     while (gameOver)
     {
-        // Check for new input.
-        SDL_PumpEvents();
-        // check is escape being pressed.
-        if (keys[SDLK_ESCAPE]) gameOver = false;
+        // Sleep until something happens.
+        if (!SDL_WaitEvent(&event)) break;
+        // check is escape being pressed (or the window closed).
+        if (keys[SDLK_ESCAPE] || event.type == SDL_QUIT) gameOver = false;
     }
 
     // Unload the map.
-    delete [] map.tiles;
-    delete [] map.map;
-    delete [] map.blocked;
+    endGame(game);
 
     // Unload the bitmaps.
+    stopRenderer(renderer);
     SDL_FreeSurface(font);
     SDL_FreeSurface(tiles);
     SDL_FreeSurface(charas);
@@ -660,4 +514,4 @@ int main (int argc, char* argv[])
     // Let SDL clean itself up.
     SDL_Quit();
 
-}
+}
\ No newline at end of file
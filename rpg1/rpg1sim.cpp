@@ -0,0 +1,194 @@
+/**
+  * Runs lots of games of RPG 1 at once, with no display, to find out how many games one core can keep going.
+  *
+  * Each game is played by a bot that wanders about, hacking at whatever it bumps into. The games are split
+  * evenly between the worker threads, and each thread steps all of its games one tick at a time, the way a
+  * server would. Game i always gets seed i, so the results don't depend on how many threads there are:
+  * the checksum printed at the end is the same for any thread count.
+  *
+  * Normally only the enemies in view of the player act. Give an active range to have the ones further away
+  * act too (a range as big as the map wakes up every enemy on it), and a number of AI threads to have each
+  * thread's games share that many threads to think with. The checksum doesn't depend on that either.
+  *
+  * Build:  g++ -O2 rpg1sim.cpp -o rpg1sim -lSDL
+  * Usage:  rpg1sim [games] [threads] [seconds of game time per game] [map] [active range] [AI threads]
+  *         rpg1sim 1000 4 60 map.bin
+  *         rpg1sim 1 1 10 big.bin 100000 8
+  *
+  * mapgen makes maps as big as you like to try it on (see mapgen.cpp).
+  */
+
+#include <cstdlib>
+#include <iostream>
+
+#include <SDL/SDL.h>    // We use this for threads and timing only.
+
+#include "game.h"       // The game itself.
+
+// Each game keeps at most this much of its map in memory. There are a lot of games.
+const size_t SIM_CHUNK_BUDGET = 256 * 1024;
+
+// The games one worker thread runs: games 'first' to 'first + count - 1'.
+struct Shard
+{
+    int first, count;
+    int ticks;              // How many ticks to run each game for.
+    const char* mapName;
+    int activeRange;        // Passed on to each game.
+    int aiThreads;          // How many threads the enemies of the shard's games think on.
+
+    // Filled in by the worker.
+    bool loaded;            // All of the games loaded.
+    unsigned int loadTime;  // How long loading the games took, in milliseconds.
+    unsigned int runTime;   // How long running them took.
+    unsigned int checksum;  // Mixes up how every game ended.
+};
+
+// The bot: pick the keys to hold down for the next tick. 'random' is the bot's own random number state.
+void botInput (Game& game, unsigned int& random, Input& input)
+{
+    // Every now and then, pick a new direction to walk in (or stand still).
+    if (game.time % 1000 == 0)
+    {
+        random = random * 1103515245 + 12345;
+        int direction = (random >> 16) % 5;
+        input.up    = direction == 0;
+        input.down  = direction == 1;
+        input.left  = direction == 2;
+        input.right = direction == 3;
+    }
+    // Tap the space bar every other tick, to attack anything beside us and open any chest we're on.
+    input.attack = (game.time / TICK_MS) % 2 == 0;
+}
+
+// A worker thread: load the games of a shard, run them, and see how they ended.
+int runShard (void* data)
+{
+    Shard& shard = *(Shard*)data;
+
+    unsigned int start = SDL_GetTicks();
+    Game* games = new Game[shard.count];
+    unsigned int* random = new unsigned int[shard.count];
+    Input* inputs = new Input[shard.count];
+    // This thread counts as one of the AI threads.
+    Workers workers;
+    startWorkers(workers, shard.aiThreads - 1);
+    int loaded = 0;
+    shard.loaded = true;
+    for (; loaded < shard.count; ++loaded)
+    {
+        // No loader thread for each game: we have plenty of threads already.
+        if (!newGame(games[loaded], shard.mapName, shard.first + loaded, SIM_CHUNK_BUDGET, false))
+        {
+            shard.loaded = false;
+            break;
+        }
+        games[loaded].activeRange = shard.activeRange;
+        games[loaded].workers = &workers;
+        random[loaded] = ~(unsigned int)(shard.first + loaded);
+        Input none = {false, false, false, false, false};
+        inputs[loaded] = none;
+    }
+    shard.loadTime = SDL_GetTicks() - start;
+
+    // Run them all, a tick at a time.
+    start = SDL_GetTicks();
+    for (int tick = 0; tick < shard.ticks; ++tick)
+    {
+        for (int i = 0; i < loaded; ++i)
+        {
+            botInput(games[i], random[i], inputs[i]);
+            stepGame(games[i], inputs[i]);
+        }
+    }
+    shard.runTime = SDL_GetTicks() - start;
+
+    // Sum up how they ended, then clean up.
+    shard.checksum = 0;
+    for (int i = 0; i < loaded; ++i)
+    {
+        Game& game = games[i];
+        unsigned int end = game.gold + game.player.health * 1000u + game.enemies.size() * 100000u
+                         + game.player.x * 7u + game.player.y * 13u + game.time;
+        // Added up, weighted by game number, so it doesn't matter which thread ran which game.
+        shard.checksum += end * (2u * (shard.first + i) + 1);
+        endGame(game);
+    }
+    stopWorkers(workers);
+    delete [] inputs;
+    delete [] random;
+    delete [] games;
+    return 0;
+}
+
+int main (int argc, char* argv[])
+{
+    int numGames   = argc > 1 ? std::atoi(argv[1]) : 1000;
+    int numThreads = argc > 2 ? std::atoi(argv[2]) : 1;
+    int seconds    = argc > 3 ? std::atoi(argv[3]) : 60;
+    const char* mapName = argc > 4 ? argv[4] : "map.txt";
+    int activeRange = argc > 5 ? std::atoi(argv[5]) : 0;
+    int aiThreads   = argc > 6 ? std::atoi(argv[6]) : 1;
+    if (numGames < 1 || numThreads < 1 || seconds < 1 || activeRange < 0 || aiThreads < 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " [games] [threads] [seconds of game time per game] [map] [active range] [AI threads]\n";
+        return 1;
+    }
+    if (numThreads > numGames) numThreads = numGames;
+
+    // We only need the timer. No window.
+    if (SDL_Init(SDL_INIT_TIMER) < 0)
+    {
+        std::cerr << "Failed to initialise SDL: " << SDL_GetError() << "\n";
+        return 1;
+    }
+
+    // Split the games between the threads, and start them.
+    int ticks = seconds * (1000 / TICK_MS);
+    std::vector<Shard> shards (numThreads);
+    std::vector<SDL_Thread*> threads (numThreads);
+    unsigned int start = SDL_GetTicks();
+    for (int i = 0; i < numThreads; ++i)
+    {
+        shards[i].first   = (long long)numGames * i / numThreads;
+        shards[i].count   = (long long)numGames * (i + 1) / numThreads - shards[i].first;
+        shards[i].ticks   = ticks;
+        shards[i].mapName = mapName;
+        shards[i].activeRange = activeRange;
+        shards[i].aiThreads = aiThreads;
+        threads[i] = SDL_CreateThread(runShard, &shards[i]);
+    }
+
+    // Wait for them all to finish.
+    unsigned int loadTime = 0, runTime = 0, checksum = 0;
+    bool loaded = true;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        SDL_WaitThread(threads[i], NULL);
+        loaded = loaded && shards[i].loaded;
+        loadTime = shards[i].loadTime > loadTime ? shards[i].loadTime : loadTime;
+        runTime  = shards[i].runTime > runTime ? shards[i].runTime : runTime;
+        checksum += shards[i].checksum;
+    }
+    unsigned int wallTime = SDL_GetTicks() - start;
+    SDL_Quit();
+
+    if (!loaded)
+    {
+        std::cerr << "Failed to load " << mapName << "\n";
+        return 1;
+    }
+
+    // A game running in real time needs 'seconds' of game time every 'seconds' seconds. How many could we keep up?
+    // (Per core assumes each thread has a core to itself.)
+    double runSeconds = (runTime > 0 ? runTime : 1) / 1000.0;
+    double realTimeGames = (double)numGames * seconds / runSeconds;
+    std::cout << numGames << " games x " << seconds << "s of game time on " << numThreads << " threads x "
+              << aiThreads << " AI threads (" << mapName << ", active range " << activeRange << ")\n";
+    std::cout << "  loaded in " << loadTime << " ms, ran in " << runTime << " ms, " << wallTime << " ms in all\n";
+    std::cout << "  " << (double)numGames * ticks / runSeconds << " ticks/sec, "
+              << realTimeGames << " games in real time, "
+              << realTimeGames / (numThreads * aiThreads) << " per core\n";
+    std::cout << "  checksum " << checksum << "\n";
+    return 0;
+}
@@ -0,0 +1,187 @@
+/**
+  * Timers: "tell me when tick N comes round", for lots of things at once, cheaply.
+  *
+  * This is a hierarchical timing wheel. Picture a clock with TIMER_SLOTS slots, one per tick: a timer due in
+  * the next TIMER_SLOTS ticks goes in the slot for its tick, and each tick we fire whatever is in the slot the
+  * hand points at. Timers due further off go in a slower wheel, whose slots are TIMER_SLOTS ticks wide, and so
+  * on up; each time the faster wheel goes round once, the slower wheel's next slot is emptied out into it. So
+  * adding, cancelling and firing a timer costs the same however many timers there are, and a tick with nothing
+  * due costs next to nothing.
+  *
+  * Each timer carries an 'owner' number, which says what it is for: the wheel doesn't care what it means.
+  * The timers are kept in one std::vector and linked up by index, so they can be reused without new/delete.
+  */
+
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <vector>
+
+// How many wheels there are, and how many slots each has. 4 wheels of 64 slots cover 2^24 ticks.
+const int TIMER_LEVELS = 4;
+const int TIMER_SLOT_BITS = 6;
+const int TIMER_SLOTS = 1 << TIMER_SLOT_BITS;
+const unsigned int TIMER_MAX_DELAY = (1u << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1;
+
+// Returned by nextTimer when there are no timers at all.
+const unsigned int TIMER_NEVER = 0xffffffffu;
+
+struct Timer
+{
+    unsigned int due;   // The tick it fires at.
+    int owner;          // What it is for.
+    int slot;           // The slot it's in (level * TIMER_SLOTS + slot), or -1 if the timer isn't in use.
+    int prev, next;     // The timers before and after it in its slot (or, if not in use, the next unused one).
+};
+
+struct TimerWheel
+{
+    unsigned int now;           // The last tick fired.
+    std::vector<Timer> timers;  // Every timer, in use or not.
+    int unused;                 // The first timer not in use, or -1.
+    int slots[TIMER_LEVELS * TIMER_SLOTS]; // The first timer in each slot, or -1.
+    int count;                  // How many timers are waiting.
+};
+
+// Start a set of wheels with no timers in it. Tick 'now' counts as already fired.
+inline void startTimers (TimerWheel& wheel, unsigned int now)
+{
+    wheel.now = now;
+    wheel.timers.clear();
+    wheel.unused = -1;
+    for (int i = 0; i < TIMER_LEVELS * TIMER_SLOTS; ++i)
+    {
+        wheel.slots[i] = -1;
+    }
+    wheel.count = 0;
+}
+
+// Put timer 'id' in the right slot for its tick.
+inline void slotTimer (TimerWheel& wheel, int id)
+{
+    Timer& timer = wheel.timers[id];
+    unsigned int delay = timer.due - wheel.now;
+    if (delay > TIMER_MAX_DELAY)
+    {
+        // Too far off for the wheels: park it in the slowest one, as far off as it goes. It is put back
+        // in the right slot when that one is emptied out.
+        delay = TIMER_MAX_DELAY;
+    }
+    // Find the fastest wheel that goes round before the timer is due.
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delay >= (1u << ((level + 1) * TIMER_SLOT_BITS)))
+    {
+        level++;
+    }
+    int slot = level * TIMER_SLOTS + (((wheel.now + delay) >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1));
+
+    // Add it to the front of the slot's list.
+    timer.slot = slot;
+    timer.prev = -1;
+    timer.next = wheel.slots[slot];
+    if (timer.next != -1) wheel.timers[timer.next].prev = id;
+    wheel.slots[slot] = id;
+}
+
+// Take timer 'id' out of its slot.
+inline void unslotTimer (TimerWheel& wheel, int id)
+{
+    Timer& timer = wheel.timers[id];
+    if (timer.prev != -1) wheel.timers[timer.prev].next = timer.next;
+    else wheel.slots[timer.slot] = timer.next;
+    if (timer.next != -1) wheel.timers[timer.next].prev = timer.prev;
+}
+
+// Set a timer to fire at tick 'due' (which must be after 'now'). Returns its id, for cancelTimer.
+inline int addTimer (TimerWheel& wheel, unsigned int due, int owner)
+{
+    int id = wheel.unused;
+    if (id != -1)
+    {
+        wheel.unused = wheel.timers[id].next;
+    } else {
+        id = wheel.timers.size();
+        wheel.timers.push_back(Timer());
+    }
+    wheel.timers[id].due = due;
+    wheel.timers[id].owner = owner;
+    slotTimer(wheel, id);
+    wheel.count++;
+    return id;
+}
+
+// Stop a timer that hasn't fired yet.
+inline void cancelTimer (TimerWheel& wheel, int id)
+{
+    unslotTimer(wheel, id);
+    wheel.timers[id].slot = -1;
+    wheel.timers[id].next = wheel.unused;
+    wheel.unused = id;
+    wheel.count--;
+}
+
+// Empty one slot of a slower wheel out into the faster ones.
+inline void cascadeTimers (TimerWheel& wheel, int level)
+{
+    int slot = level * TIMER_SLOTS + ((wheel.now >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1));
+    int id = wheel.slots[slot];
+    wheel.slots[slot] = -1;
+    while (id != -1)
+    {
+        int next = wheel.timers[id].next;
+        slotTimer(wheel, id);
+        id = next;
+    }
+}
+
+// Move on to the next tick, and add the owners of the timers that fire to 'fired' (in no particular order).
+// Fired timers are done with: their ids may be handed out again straight away.
+inline void advanceTimers (TimerWheel& wheel, std::vector<int>& fired)
+{
+    wheel.now++;
+    // Each time a wheel comes back round to slot 0, the next slot of the wheel above is due to be emptied.
+    // (Slowest first, so what falls out of it lands in the right slot of the faster wheels.)
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && ((wheel.now >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1)) == 0)
+    {
+        level++;
+    }
+    for (; level > 0; --level)
+    {
+        cascadeTimers(wheel, level);
+    }
+
+    // Everything in the fastest wheel's slot is due now.
+    int slot = wheel.now & (TIMER_SLOTS - 1);
+    int id = wheel.slots[slot];
+    wheel.slots[slot] = -1;
+    while (id != -1)
+    {
+        Timer& timer = wheel.timers[id];
+        int next = timer.next;
+        fired.push_back(timer.owner);
+        timer.slot = -1;
+        timer.next = wheel.unused;
+        wheel.unused = id;
+        wheel.count--;
+        id = next;
+    }
+}
+
+// The first tick that might have something to fire, or TIMER_NEVER if there are no timers.
+// This may be too early (a timer in a slower wheel is only known to be due some time after its slot is
+// emptied out), but it is never too late.
+inline unsigned int nextTimer (const TimerWheel& wheel)
+{
+    if (wheel.count == 0) return TIMER_NEVER;
+    for (int i = 1; i <= TIMER_SLOTS; ++i)
+    {
+        unsigned int tick = wheel.now + i;
+        if (wheel.slots[tick & (TIMER_SLOTS - 1)] != -1) return tick;
+        // A slower wheel is emptied out here, and we can't tell when what comes out of it is due.
+        if ((tick & (TIMER_SLOTS - 1)) == 0) return tick;
+    }
+    return wheel.now + TIMER_SLOTS;
+}
+
+#endif // TIMERS_H
@@ -0,0 +1,136 @@
+/**
+  * A pool of worker threads, for splitting a big job into lots of little tasks and running them all at once.
+  *
+  * runTasks hands out tasks 0 to numTasks-1 to whichever thread is free next (including the one that called
+  * it, which would only be waiting otherwise), and returns when all of them are done. Tasks may run in any
+  * order, on any thread, so each task must only write to things no other task touches.
+  *
+  * Only one thread at a time may call runTasks on a pool.
+  */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <vector>
+
+#include <SDL/SDL.h>    // We use SDL's threads.
+
+// A task: 'index' says which one.
+typedef void (*Task) (void* data, int index);
+
+struct Workers
+{
+    std::vector<SDL_Thread*> threads;
+    // Take 'lock' before touching anything below.
+    SDL_mutex* lock;
+    SDL_cond* wake;         // Signalled when there are tasks to do (or it's time to quit).
+    SDL_cond* done;         // Signalled when the last task is done.
+    Task task;              // The job being run,
+    void* data;             // and what it works on.
+    int numTasks;           // How many tasks the job has,
+    int nextTask;           // the next one to be handed out,
+    int unfinished;         // and how many have not finished yet.
+    bool quit;
+};
+
+// A worker thread: run tasks until told to quit.
+inline int workerThread (void* data)
+{
+    Workers& workers = *(Workers*)data;
+    SDL_mutexP(workers.lock);
+    while (!workers.quit)
+    {
+        if (workers.nextTask >= workers.numTasks)
+        {
+            // Nothing to do, so sleep until there is.
+            SDL_CondWait(workers.wake, workers.lock);
+            continue;
+        }
+        int index = workers.nextTask++;
+
+        // Don't hold the lock while working.
+        SDL_mutexV(workers.lock);
+        workers.task(workers.data, index);
+        SDL_mutexP(workers.lock);
+
+        if (--workers.unfinished == 0) SDL_CondSignal(workers.done);
+    }
+    SDL_mutexV(workers.lock);
+    return 0;
+}
+
+// Start 'count' worker threads. Along with the thread calling runTasks, that makes count+1 threads working.
+inline void startWorkers (Workers& workers, int count)
+{
+    workers.lock = SDL_CreateMutex();
+    workers.wake = SDL_CreateCond();
+    workers.done = SDL_CreateCond();
+    workers.task = NULL;
+    workers.data = NULL;
+    workers.numTasks = workers.nextTask = workers.unfinished = 0;
+    workers.quit = false;
+    for (int i = 0; i < count; ++i)
+    {
+        SDL_Thread* thread = SDL_CreateThread(workerThread, &workers);
+        // If we can't start a thread, we make do with the ones we have.
+        if (thread != NULL) workers.threads.push_back(thread);
+    }
+}
+
+// Stop the worker threads.
+inline void stopWorkers (Workers& workers)
+{
+    SDL_mutexP(workers.lock);
+    workers.quit = true;
+    SDL_CondBroadcast(workers.wake);
+    SDL_mutexV(workers.lock);
+    for (unsigned i = 0; i < workers.threads.size(); ++i)
+    {
+        SDL_WaitThread(workers.threads[i], NULL);
+    }
+    workers.threads.clear();
+    SDL_DestroyCond(workers.done);
+    SDL_DestroyCond(workers.wake);
+    SDL_DestroyMutex(workers.lock);
+}
+
+// Run tasks 0 to numTasks-1, and wait for them all to finish. If 'workers' is NULL (or has no threads), the
+// tasks simply run one after the other on this thread.
+inline void runTasks (Workers* workers, int numTasks, Task task, void* data)
+{
+    if (workers == NULL || workers->threads.empty() || numTasks < 2)
+    {
+        for (int i = 0; i < numTasks; ++i)
+        {
+            task(data, i);
+        }
+        return;
+    }
+
+    SDL_mutexP(workers->lock);
+    workers->task = task;
+    workers->data = data;
+    workers->numTasks = numTasks;
+    workers->nextTask = 0;
+    workers->unfinished = numTasks;
+    SDL_CondBroadcast(workers->wake);
+
+    // Lend a hand rather than just waiting.
+    while (workers->nextTask < workers->numTasks)
+    {
+        int index = workers->nextTask++;
+        SDL_mutexV(workers->lock);
+        task(data, index);
+        SDL_mutexP(workers->lock);
+        --workers->unfinished;
+    }
+    while (workers->unfinished > 0)
+    {
+        SDL_CondWait(workers->done, workers->lock);
+    }
+    // Nothing left for the workers to pick up.
+    workers->numTasks = workers->nextTask = 0;
+    SDL_mutexV(workers->lock);
+}
+
+#endif // WORKERS_H
@@ -0,0 +1,581 @@
+/**
+  * The game world: the map, and the characters and items on it.
+  *
+  * The map is never held in memory all at once. It is cut into chunks of MAP_CHUNK_SIZE x MAP_CHUNK_SIZE
+  * cells (see mapfile.h), and only the chunks around the player are kept, up to a memory budget. A
+  * background thread loads the chunks just beyond the player's view before they are needed, and the
+  * chunks that have gone unused longest are thrown away to make room. That way a dungeon of any size
+  * takes the same memory, and it starts instantly.
+  *
+  * Always get at the map through tileAt, isWalkable, isBlocked and setBlocked, and call updateChunks
+  * once a frame with the part of the map on screen.
+  */
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <cstdlib>
+#include <cstring>      // We use this to copy chunks.
+#include <map>          // We use this to remember the blocked cells of chunks which aren't in memory.
+#include <vector>       // We use this to store a list of enemies and items.
+
+#if defined(_WIN32)
+#include <cstdio>       // Windows has no mmap, so we read the whole map file instead.
+#else
+#include <fcntl.h>      // We use these to map the binary map file into memory.
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <SDL/SDL.h>    // We use SDL's threads to load chunks in the background.
+
+#include "mapfile.h"    // The binary map format.
+
+// Set this to whatever you want the enemies health to be.
+const int ENEMY_MAX_HEALTH = 3;
+
+// How much memory the chunks of a map may take, unless you tell loadMap otherwise.
+const size_t CHUNK_BUDGET = 4 * 1024 * 1024;
+
+// We start loading a chunk when the player's view comes this many cells from it.
+const int CHUNK_PREFETCH = MAP_CHUNK_SIZE / 2;
+
+// We always keep at least this many chunks, so the ones on screen and the ones being prefetched fit.
+const int CHUNK_MIN = 16;
+
+// The most important data structure in the game.
+struct Tile
+{
+    // Offset to image.
+    unsigned offsetX, offsetY;
+    // If true, this tile can be walked on.
+    bool walkable;
+};
+
+// A piece of the map that is in memory.
+struct Chunk
+{
+    int index;                      // Which chunk of the map this is: (chunk row * chunks per row) + chunk column.
+    int tiles[MAP_CHUNK_CELLS];     // Indices into the array of tiles, row by row.
+    bool blocked[MAP_CHUNK_CELLS];  // These cells are temporarily blocked (ie: there is an enemy standing there).
+    int numBlocked;                 // How many cells are blocked. If any are, we remember them when the chunk goes.
+    Chunk* newer;                   // The chunks in memory, from the most recently used to the least.
+    Chunk* older;
+};
+
+// The second most important data structure in the game.
+// Once loaded, a map must stay where it is: the chunk loading thread holds on to it.
+struct Map
+{
+    int numTiles;       // How many different tiles?
+    Tile* tiles;        // Store the tiles.
+    int width, height;  // Width and height of the map, in tiles.
+
+    int chunksWide, chunksHigh;     // Width and height of the map, in chunks.
+    Chunk** chunks;                 // The chunk in memory for each chunk of the map, or NULL.
+    Chunk* newest;                  // The most recently used chunk in memory.
+    Chunk* oldest;                  // The least recently used, the next to go.
+    int numChunks;                  // How many chunks are in memory.
+    int maxChunks;                  // How many chunks we may keep in memory.
+    std::map<int, std::vector<int> > parked; // Blocked cells of chunks that are not in memory, by chunk.
+
+    // Where chunks come from: the tile index of every cell, in the chunk order of mapfile.h.
+    int* cells;
+    char* file;         // The binary map file, if that is what we loaded. 'cells' points into it.
+    size_t fileSize;    // Size of the binary map file.
+
+    // The chunk loading thread. It loads the chunks in 'wanted' and puts them in 'ready'.
+    // Take 'lock' before touching 'wanted', 'ready' or 'quit'.
+    SDL_Thread* loader;
+    SDL_mutex* lock;
+    SDL_cond* wake;                 // Signalled when there is something for the loader to do.
+    std::vector<int> wanted;
+    std::vector<Chunk*> ready;
+    bool quit;
+    std::vector<char> pending;      // Chunks we have asked the loader for. Only the game uses this, not the loader.
+};
+
+// The third most important data structure in the game.
+struct Character
+{
+    // Self-explanatory.
+    int health;
+
+    // Current position on the map.
+    int x, y;
+
+    // Offset to the image to be used.
+    int image;
+
+    // Parameter. We use this to manage frequency of enemy attacks. You can use it for other things for other character types.
+    unsigned int parameter;
+};
+
+struct Item
+{
+    // Position of the item.
+    int x, y;
+
+    // Image offsets for the item.
+    int offsetX, offsetY;
+
+    // Type of item.
+    int type; // In this version, all items are chests, so type is how much gold the chest contains. Use your imagination here though.
+};
+
+// Bring a binary map file into memory. Returns NULL if the file can't be read.
+// On most systems the file is mapped rather than read, so this takes no time at all, however big the map:
+// the operating system only loads the parts of the file we actually touch, when we touch them.
+inline char* openMapFile (const char* filename, size_t& size)
+{
+#if defined(_WIN32)
+    // No mmap here, so we read the file into memory in one go.
+    std::FILE* file = std::fopen(filename, "rb");
+    if (!file) return NULL;
+    std::fseek(file, 0, SEEK_END);
+    size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    char* data = new char[size];
+    if (std::fread(data, 1, size, file) != size)
+    {
+        delete [] data;
+        data = NULL;
+    }
+    std::fclose(file);
+    return data;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    size = st.st_size;
+    // A private, read only mapping: nothing we do to it ever changes the file.
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the file is closed.
+    close(fd);
+    return data == MAP_FAILED ? NULL : (char*)data;
+#endif
+}
+
+// Give back the memory of a map file from openMapFile.
+inline void closeMapFile (char* data, size_t size)
+{
+#if defined(_WIN32)
+    delete [] data;
+#else
+    munmap(data, size);
+#endif
+}
+
+// Read chunk 'index' of the map into a new chunk. Both the game and the loader thread call this.
+inline Chunk* readChunk (Map& map, int index)
+{
+    Chunk* chunk = new Chunk;
+    chunk->index = index;
+    const int* source = map.cells + (size_t)index * MAP_CHUNK_CELLS;
+    std::memcpy(chunk->tiles, source, sizeof(chunk->tiles));
+    // A mangled map file could send us off the end of the tile table. Those cells get the first tile.
+    for (int i = 0; i < MAP_CHUNK_CELLS; ++i)
+    {
+        if ((unsigned)chunk->tiles[i] >= (unsigned)map.numTiles) chunk->tiles[i] = 0;
+    }
+    std::memset(chunk->blocked, 0, sizeof(chunk->blocked));
+    chunk->numBlocked = 0;
+    chunk->newer = chunk->older = NULL;
+#if !defined(_WIN32)
+    if (map.file != NULL)
+    {
+        // We have our copy, so the operating system can drop its copy of this part of the file.
+        // Chunks start on a page boundary in the file (see mapfile.h), and are a whole number of pages.
+        madvise((void*)source, sizeof(chunk->tiles), MADV_DONTNEED);
+    }
+#endif
+    return chunk;
+}
+
+// Make a chunk the most recently used.
+inline void touchChunk (Map& map, Chunk* chunk)
+{
+    if (map.newest == chunk) return;
+    // Take it out of the list...
+    if (chunk->newer) chunk->newer->older = chunk->older;
+    if (chunk->older) chunk->older->newer = chunk->newer;
+    if (map.oldest == chunk) map.oldest = chunk->newer;
+    // ...and put it back at the front.
+    chunk->newer = NULL;
+    chunk->older = map.newest;
+    if (map.newest) map.newest->newer = chunk;
+    map.newest = chunk;
+    if (map.oldest == NULL) map.oldest = chunk;
+}
+
+// Put a chunk that was just read into the map.
+inline void addChunk (Map& map, Chunk* chunk)
+{
+    map.chunks[chunk->index] = chunk;
+    ++map.numChunks;
+    chunk->newer = chunk->older = NULL;
+    touchChunk(map, chunk);
+
+    // If enemies were standing on this chunk when it was last thrown away, they still are.
+    std::map<int, std::vector<int> >::iterator parked = map.parked.find(chunk->index);
+    if (parked != map.parked.end())
+    {
+        for (unsigned i = 0; i < parked->second.size(); ++i)
+        {
+            chunk->blocked[parked->second[i]] = true;
+        }
+        chunk->numBlocked = parked->second.size();
+        map.parked.erase(parked);
+    }
+}
+
+// Throw away the least recently used chunk.
+inline void dropOldestChunk (Map& map)
+{
+    Chunk* chunk = map.oldest;
+    // Remember which cells were blocked.
+    if (chunk->numBlocked > 0)
+    {
+        std::vector<int>& cells = map.parked[chunk->index];
+        for (int i = 0; i < MAP_CHUNK_CELLS; ++i)
+        {
+            if (chunk->blocked[i]) cells.push_back(i);
+        }
+    }
+    map.oldest = chunk->newer;
+    if (map.oldest) map.oldest->older = NULL; else map.newest = NULL;
+    map.chunks[chunk->index] = NULL;
+    --map.numChunks;
+    delete chunk;
+}
+
+// The chunk holding cell (x, y), which must be on the map. If it isn't in memory, we read it right now.
+inline Chunk* chunkAt (Map& map, int x, int y)
+{
+    int index = (y >> MAP_CHUNK_SHIFT) * map.chunksWide + (x >> MAP_CHUNK_SHIFT);
+    Chunk* chunk = map.chunks[index];
+    if (chunk == NULL)
+    {
+        // The loader didn't get to it in time (or the player teleported).
+        chunk = readChunk(map, index);
+        addChunk(map, chunk);
+    }
+    return chunk;
+}
+
+// Where cell (x, y) is within its chunk.
+inline int chunkCell (int x, int y)
+{
+    return ((y & (MAP_CHUNK_SIZE - 1)) << MAP_CHUNK_SHIFT) + (x & (MAP_CHUNK_SIZE - 1));
+}
+
+// Is (x, y) on the map at all?
+inline bool onMap (Map& map, int x, int y)
+{
+    return x >= 0 && y >= 0 && x < map.width && y < map.height;
+}
+
+// Index into map.tiles of the tile at (x, y), which must be on the map.
+inline int tileAt (Map& map, int x, int y)
+{
+    return chunkAt(map, x, y)->tiles[chunkCell(x, y)];
+}
+
+// Can (x, y) be walked on? Cells off the map can't.
+inline bool isWalkable (Map& map, int x, int y)
+{
+    return onMap(map, x, y) && map.tiles[tileAt(map, x, y)].walkable;
+}
+
+// Is (x, y) blocked (ie: is there an enemy standing there)? Cells off the map aren't.
+inline bool isBlocked (Map& map, int x, int y)
+{
+    return onMap(map, x, y) && chunkAt(map, x, y)->blocked[chunkCell(x, y)];
+}
+
+// Block or unblock (x, y).
+inline void setBlocked (Map& map, int x, int y, bool blocked)
+{
+    if (!onMap(map, x, y)) return;
+    Chunk* chunk = chunkAt(map, x, y);
+    bool& cell = chunk->blocked[chunkCell(x, y)];
+    if (cell != blocked)
+    {
+        chunk->numBlocked += blocked ? 1 : -1;
+        cell = blocked;
+    }
+}
+
+// The chunk loading thread.
+inline int chunkLoader (void* data)
+{
+    Map& map = *(Map*)data;
+    SDL_mutexP(map.lock);
+    while (!map.quit)
+    {
+        if (map.wanted.empty())
+        {
+            // Nothing to do, so sleep until there is.
+            SDL_CondWait(map.wake, map.lock);
+            continue;
+        }
+        // The last chunk asked for is the one most likely still needed.
+        int index = map.wanted.back();
+        map.wanted.pop_back();
+
+        // Don't hold the lock while reading, that's the slow part.
+        SDL_mutexV(map.lock);
+        Chunk* chunk = readChunk(map, index);
+        SDL_mutexP(map.lock);
+
+        map.ready.push_back(chunk);
+    }
+    SDL_mutexV(map.lock);
+    return 0;
+}
+
+// Call this once a frame, with the part of the map on screen (in tiles).
+// Picks up the chunks the loader has read, asks it for the chunks around the screen, and throws away the
+// least recently used chunks if we're over budget.
+inline void updateChunks (Map& map, int x, int y, int w, int h)
+{
+    // First, take in the chunks the loader has finished with.
+    std::vector<Chunk*> ready;
+    SDL_mutexP(map.lock);
+    ready.swap(map.ready);
+    SDL_mutexV(map.lock);
+    for (unsigned i = 0; i < ready.size(); ++i)
+    {
+        map.pending[ready[i]->index] = false;
+        if (map.chunks[ready[i]->index] == NULL)
+        {
+            addChunk(map, ready[i]);
+        } else
+        {
+            // We couldn't wait, and read it ourselves already.
+            delete ready[i];
+        }
+    }
+
+    // The chunks on screen are the ones we used most recently.
+    int left = x < 0 ? 0 : x, top = y < 0 ? 0 : y;
+    int right = x + w > map.width ? map.width : x + w, bottom = y + h > map.height ? map.height : y + h;
+    for (int cy = top >> MAP_CHUNK_SHIFT; cy <= (bottom - 1) >> MAP_CHUNK_SHIFT; ++cy)
+    {
+        for (int cx = left >> MAP_CHUNK_SHIFT; cx <= (right - 1) >> MAP_CHUNK_SHIFT; ++cx)
+        {
+            touchChunk(map, chunkAt(map, cx << MAP_CHUNK_SHIFT, cy << MAP_CHUNK_SHIFT));
+        }
+    }
+
+    // Ask for the chunks the player is getting close to.
+    if (map.loader != NULL)
+    {
+        left   = x - CHUNK_PREFETCH < 0 ? 0 : x - CHUNK_PREFETCH;
+        top    = y - CHUNK_PREFETCH < 0 ? 0 : y - CHUNK_PREFETCH;
+        right  = x + w + CHUNK_PREFETCH > map.width  ? map.width  : x + w + CHUNK_PREFETCH;
+        bottom = y + h + CHUNK_PREFETCH > map.height ? map.height : y + h + CHUNK_PREFETCH;
+        bool asked = false;
+        SDL_mutexP(map.lock);
+        for (int cy = top >> MAP_CHUNK_SHIFT; cy <= (bottom - 1) >> MAP_CHUNK_SHIFT; ++cy)
+        {
+            for (int cx = left >> MAP_CHUNK_SHIFT; cx <= (right - 1) >> MAP_CHUNK_SHIFT; ++cx)
+            {
+                int index = cy * map.chunksWide + cx;
+                if (map.chunks[index] == NULL && !map.pending[index])
+                {
+                    map.pending[index] = true;
+                    map.wanted.push_back(index);
+                    asked = true;
+                }
+            }
+        }
+        if (asked) SDL_CondSignal(map.wake);
+        SDL_mutexV(map.lock);
+    }
+
+    // Finally, stay within budget.
+    while (map.numChunks > map.maxChunks)
+    {
+        dropOldestChunk(map);
+    }
+}
+
+// This loads a game map from disk into the internal map data structure.
+// Binary maps (made from text maps by mapconv) are read a chunk at a time as they are needed; anything
+// else is read as a text map. 'budget' is how many bytes of chunks to keep in memory. If 'background' is
+// false, no loader thread is started and chunks are read as they are needed (use this when running lots of
+// maps at once). Returns false if the map couldn't be loaded.
+inline bool loadMap (Map& map, int& startX, int& startY, std::vector<Item>& items, std::vector<Character>& enemies, const char* filename,
+                     size_t budget = CHUNK_BUDGET, bool background = true)
+{
+    map.file = openMapFile(filename, map.fileSize);
+
+    // Is it a binary map?
+    const MapFileHeader* header = (const MapFileHeader*)map.file;
+    if (map.file != NULL && (map.fileSize < sizeof(MapFileHeader) ||
+        header->magic[0] != MAP_FILE_MAGIC[0] || header->magic[1] != MAP_FILE_MAGIC[1] ||
+        header->magic[2] != MAP_FILE_MAGIC[2] || header->magic[3] != MAP_FILE_MAGIC[3] ||
+        header->version != MAP_FILE_VERSION))
+    {
+        // No, so we don't need it in memory.
+        closeMapFile(map.file, map.fileSize);
+        map.file = NULL;
+    }
+
+    if (map.file != NULL && !mapFileValid(map.file, map.fileSize))
+    {
+        // It is, but it's been cut short or mangled. Reading it as a text map won't help.
+        closeMapFile(map.file, map.fileSize);
+        map.file = NULL;
+        return false;
+    }
+
+    if (map.file != NULL)
+    {
+        // It is. The tile table is tiny, so we copy it into our own tiles.
+        const MapFileTile* fileTiles = (const MapFileTile*)(map.file + header->tilesOffset);
+        map.numTiles = header->numTiles;
+        map.tiles = new Tile[map.numTiles];
+        for (int i = 0; i < map.numTiles; ++i)
+        {
+            map.tiles[i].offsetX  = fileTiles[i].offsetX;
+            map.tiles[i].offsetY  = fileTiles[i].offsetY;
+            map.tiles[i].walkable = fileTiles[i].walkable != 0;
+        }
+
+        // The cells are far bigger, so we leave them in the file until their chunks are needed.
+        map.width  = header->width;
+        map.height = header->height;
+        map.cells  = (int*)(map.file + header->mapOffset);
+        startX     = header->startX;
+        startY     = header->startY;
+
+        // Then the chests and the enemies.
+        const MapFileChest* chests = (const MapFileChest*)(map.file + header->chestsOffset);
+        for (unsigned i = 0; i < header->numChests; ++i)
+        {
+            Item chest = {chests[i].x, chests[i].y, chests[i].offsetX, chests[i].offsetY, chests[i].gold};
+            items.push_back(chest);
+        }
+        const MapFileEnemy* fileEnemies = (const MapFileEnemy*)(map.file + header->enemiesOffset);
+        for (unsigned i = 0; i < header->numEnemies; ++i)
+        {
+            Character enemy = {ENEMY_MAX_HEALTH, fileEnemies[i].x, fileEnemies[i].y, 64, 0};
+            enemies.push_back(enemy);
+        }
+    } else
+    {
+        // A text map. We read it into the same records a binary map holds, then copy them over.
+        // Text maps are small, so we keep all of their cells in memory to read chunks from.
+        MapFileHeader textHeader;
+        std::vector<MapFileTile> tiles;
+        std::vector<MapInt> cells;
+        std::vector<MapFileChest> chests;
+        std::vector<MapFileEnemy> fileEnemies;
+        if (!readTextMap(filename, textHeader, tiles, cells, chests, fileEnemies)) return false;
+
+        map.numTiles = tiles.size();
+        map.tiles = new Tile[map.numTiles];
+        for (int i = 0; i < map.numTiles; ++i)
+        {
+            map.tiles[i].offsetX  = tiles[i].offsetX;
+            map.tiles[i].offsetY  = tiles[i].offsetY;
+            map.tiles[i].walkable = tiles[i].walkable != 0;
+        }
+
+        map.width  = textHeader.width;
+        map.height = textHeader.height;
+        map.cells  = new int[cells.size()];
+        for (unsigned i = 0; i < cells.size(); ++i)
+        {
+            map.cells[i] = cells[i];
+        }
+        startX = textHeader.startX;
+        startY = textHeader.startY;
+
+        for (unsigned i = 0; i < chests.size(); ++i)
+        {
+            Item chest = {chests[i].x, chests[i].y, chests[i].offsetX, chests[i].offsetY, chests[i].gold};
+            items.push_back(chest);
+        }
+        for (unsigned i = 0; i < fileEnemies.size(); ++i)
+        {
+            Character enemy = {ENEMY_MAX_HEALTH, fileEnemies[i].x, fileEnemies[i].y, 64, 0};
+            enemies.push_back(enemy);
+        }
+    }
+
+    // No chunks are in memory yet.
+    map.chunksWide = mapChunks(map.width);
+    map.chunksHigh = mapChunks(map.height);
+    map.chunks     = new Chunk*[map.chunksWide * map.chunksHigh](); // The () sets them all to NULL.
+    map.newest     = map.oldest = NULL;
+    map.numChunks  = 0;
+    map.maxChunks  = budget / sizeof(Chunk);
+    if (map.maxChunks < CHUNK_MIN) map.maxChunks = CHUNK_MIN;
+    map.pending.assign(map.chunksWide * map.chunksHigh, false);
+
+    // Enemies block the cells they stand on. We note the cells down just as if their chunks had been thrown
+    // away, so they get blocked as each chunk comes in, and we don't have to read any chunks now.
+    for (unsigned i = 0; i < enemies.size(); ++i)
+    {
+        int index = (enemies[i].y >> MAP_CHUNK_SHIFT) * map.chunksWide + (enemies[i].x >> MAP_CHUNK_SHIFT);
+        map.parked[index].push_back(chunkCell(enemies[i].x, enemies[i].y));
+    }
+
+    // Start the loader. If we can't, chunks are read as they are needed instead.
+    map.quit   = false;
+    map.lock   = SDL_CreateMutex();
+    map.wake   = SDL_CreateCond();
+    map.loader = background ? SDL_CreateThread(chunkLoader, &map) : NULL;
+    return true;
+}
+
+// Free everything loadMap allocated.
+inline void unloadMap (Map& map)
+{
+    // Stop the loader.
+    if (map.loader != NULL)
+    {
+        SDL_mutexP(map.lock);
+        map.quit = true;
+        SDL_CondSignal(map.wake);
+        SDL_mutexV(map.lock);
+        SDL_WaitThread(map.loader, NULL);
+    }
+    for (unsigned i = 0; i < map.ready.size(); ++i)
+    {
+        delete map.ready[i];
+    }
+    map.ready.clear();
+    map.wanted.clear();
+    SDL_DestroyCond(map.wake);
+    SDL_DestroyMutex(map.lock);
+
+    // Free the chunks.
+    while (map.oldest != NULL)
+    {
+        dropOldestChunk(map);
+    }
+    map.parked.clear();
+    delete [] map.chunks;
+
+    delete [] map.tiles;
+    if (map.file != NULL)
+    {
+        // The cells live in the map file.
+        closeMapFile(map.file, map.fileSize);
+    } else
+    {
+        delete [] map.cells;
+    }
+}
+
+#endif // WORLD_H